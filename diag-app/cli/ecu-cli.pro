@@ -0,0 +1,20 @@
+#-------------------------------------------------
+#
+# ecu-cli - diagnostyka ECU z linii poleceń
+#
+#-------------------------------------------------
+
+QT       -= gui
+
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TARGET = ecu-cli
+TEMPLATE = app
+
+include(../ecuproto.pri)
+
+SOURCES += main.cpp \
+        ecucli.cpp
+
+HEADERS += ecucli.h
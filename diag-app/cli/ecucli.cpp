@@ -0,0 +1,629 @@
+#include "ecucli.h"
+#include <QCoreApplication>
+#include <QSerialPortInfo>
+#include <QFile>
+#include <QSharedPointer>
+#include <signal.h>
+#include <stdio.h>
+
+static const char * const _paramNames[PARAM_COUNT] = {
+    "cut_off_start", "cut_off_end", "dynamic_on", "dynamic_off", "current_map",
+    "immo_enabled", "crank_offset", "dwell_time", "limit_window"
+};
+
+static volatile sig_atomic_t _interrupted;
+
+static void cli_sigint(int sig) {
+    (void)sig;
+    _interrupted = 1;
+}
+
+static void cli_print(const QString & text) {
+    fputs(text.toLocal8Bit().constData(), stdout);
+    fflush(stdout);
+}
+
+static void cli_error(const QString & text) {
+    fprintf(stderr, "%s\n", text.toLocal8Bit().constData());
+}
+
+/*
+ * Plik mapy: linie "rpm:" i "load:" z osiami (dziesiętnie), potem MAP_ROWS
+ * wierszy po MAP_RPM_SIZE komórek [°]. Od '#' do końca linii komentarz.
+ */
+bool EcuMapFile::load(const QString & fileName, QString * error) {
+    QFile file(fileName);
+    int line = 0;
+
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        *error = QString::fromUtf8("Nie można otworzyć pliku %1").arg(fileName);
+        return false;
+    }
+
+    rpmAxis.clear();
+    loadAxis.clear();
+    cells.clear();
+
+    while (!file.atEnd()) {
+        QString text = QString::fromLocal8Bit(file.readLine());
+        int comment = text.indexOf('#');
+
+        line++;
+        if (comment >= 0) {
+            text.truncate(comment);
+        }
+        text = text.trimmed();
+        if (text.isEmpty()) {
+            continue;
+        }
+
+        if (text.startsWith("rpm:")) {
+            rpmAxis = EcuProtocol::parseAxis(text.mid(4), MAP_RPM_SIZE, 0xFFFF);
+        }
+        else if (text.startsWith("load:")) {
+            loadAxis = EcuProtocol::parseAxis(text.mid(5), MAP_LOAD_SIZE, MAP_LOAD_MAX);
+        }
+        else {
+            QStringList items = text.split(' ', QString::SkipEmptyParts);
+            bool ok;
+
+            if (items.count() != MAP_RPM_SIZE) {
+                *error = QString::fromUtf8("Linia %1: oczekiwano %2 komórek").arg(line).arg(MAP_RPM_SIZE);
+                return false;
+            }
+
+            foreach (const QString & item, items) {
+                cells.append(item.toInt(&ok));
+                if (!ok) {
+                    *error = QString::fromUtf8("Linia %1: nieprawidłowa komórka \"%2\"").arg(line).arg(item);
+                    return false;
+                }
+            }
+        }
+    }
+
+    if ((rpmAxis.isEmpty()) || (loadAxis.isEmpty())) {
+        *error = QString::fromUtf8("Nieprawidłowe osie mapy (oczekiwano %1 i %2 rosnących wartości)").arg(MAP_RPM_SIZE).arg(MAP_LOAD_SIZE);
+        return false;
+    }
+
+    if (cells.count() != MAP_ROWS * MAP_RPM_SIZE) {
+        *error = QString::fromUtf8("Oczekiwano %1 wierszy mapy, jest %2").arg(MAP_ROWS).arg(cells.count() / MAP_RPM_SIZE);
+        return false;
+    }
+
+    if (EcuProtocol::mapError(cells) >= 0) {
+        int cell = EcuProtocol::mapError(cells);
+
+        *error = QString::fromUtf8("Nieprawidłowe wyprzedzenie w komórce (%1, %2), dozwolone 0 - %3").arg(cell / MAP_RPM_SIZE + 1).arg(cell % MAP_RPM_SIZE + 1).arg(MAP_ADVANCE_MAX);
+        return false;
+    }
+
+    return true;
+}
+
+QString EcuMapFile::toText() const {
+    QString text;
+    QStringList items;
+
+    foreach (int value, rpmAxis) {
+        items.append(QString::number(value));
+    }
+    text.append(QString("rpm: %1\n").arg(items.join(" ")));
+
+    items.clear();
+    foreach (int value, loadAxis) {
+        items.append(QString::number(value));
+    }
+    text.append(QString("load: %1\n").arg(items.join(" ")));
+
+    for(int row = 0; row < MAP_ROWS; row++) {
+        if ((row % MAP_LOAD_SIZE) == 0) {
+            text.append(QString("# mapa %1\n").arg(row / MAP_LOAD_SIZE + 1));
+        }
+
+        items.clear();
+        for(int col = 0; col < MAP_RPM_SIZE; col++) {
+            items.append(QString("%1").arg(cells.at(row * MAP_RPM_SIZE + col), 2));
+        }
+        text.append(items.join(" ") + "\n");
+    }
+
+    return text;
+}
+
+bool EcuMapFile::save(const QString & fileName) const {
+    QFile file(fileName);
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        return false;
+    }
+
+    return file.write(toText().toLocal8Bit()) >= 0;
+}
+
+EcuCli::EcuCli(const QStringList & args, QObject * parent) : QObject(parent) {
+    _args = args;
+    _timeout = ECULINK_TIMEOUT;
+    _duration = 0;
+    _frames = 0;
+    _lastStats = 0;
+    _stats = LogThreadStats();
+
+    _link = new EcuLink(this);
+    connect(_link, SIGNAL(frameReceived(EcuFrame)), this, SLOT(_frameReceived(EcuFrame)));
+    connect(_link, SIGNAL(portError()), this, SLOT(_portError()));
+
+    _logThread = new LogThread(this);
+
+    _timer = new QTimer(this);
+    _timer->setSingleShot(false);
+    _timer->setInterval(ECUCLI_STATS_PERIOD / 10);
+    connect(_timer, SIGNAL(timeout()), this, SLOT(_logStats()));
+}
+
+EcuCli::~EcuCli() {
+    _logThread->close();
+}
+
+void EcuCli::usage() {
+    cli_error(QString::fromUtf8(
+        "Użycie: ecu-cli [-p port] [-t timeout_ms] polecenie [argumenty]\n"
+        "  -p  port szeregowy albo pseudoterminal (domyślnie pierwszy \"MZ ETZ ECU\")\n"
+        "  -t  czas na odpowiedź ECU [ms] (domyślnie %1)\n"
+        "Polecenia:\n"
+        "  version                        wersja firmware\n"
+        "  read-map [plik]                osie i mapy do pliku (bez pliku na stdout)\n"
+        "  write-map plik                 osie i mapy z pliku (format jak read-map)\n"
+        "  read-params                    parametry (numer nazwa wartość)\n"
+        "  write-params nazwa=wartość ... zmiana parametrów (nazwa albo numer), reszta bez zmian\n"
+        "  read-keys                      kody immobilizera\n"
+        "  write-keys kod0 kod1           zapis kodów immobilizera\n"
+        "  log plik.etzlog [sekundy]      transmisja co obrót do logu binarnego (0 - do Ctrl+C)\n"
+        "  bench [ilość]                  opóźnienie poleceń 'd' (domyślnie %2)").arg(ECULINK_TIMEOUT).arg(ECUCLI_BENCH_COMMANDS));
+}
+
+void EcuCli::start() {
+    QStringList args = _args;
+    QString command;
+
+    while ((!args.isEmpty()) && (args.first().startsWith('-'))) {
+        QString option = args.takeFirst();
+
+        if (args.isEmpty()) {
+            usage();
+            _finish(1);
+            return;
+        }
+
+        if (option == "-p") {
+            _port = args.takeFirst();
+        }
+        else if (option == "-t") {
+            _timeout = args.takeFirst().toInt();
+        }
+        else {
+            usage();
+            _finish(1);
+            return;
+        }
+    }
+
+    if (args.isEmpty()) {
+        usage();
+        _finish(1);
+        return;
+    }
+    command = args.takeFirst();
+
+    if (_port.isEmpty()) {
+        foreach (const QSerialPortInfo & info, QSerialPortInfo::availablePorts()) {
+            if (info.description() == "MZ ETZ ECU") {
+                _port = info.systemLocation();
+                break;
+            }
+        }
+    }
+
+    if (_port.isEmpty()) {
+        cli_error(QString::fromUtf8("Nie znaleziono ECU, podaj port (-p)"));
+        _finish(1);
+        return;
+    }
+
+    if (!_link->open(_port)) {
+        cli_error(QString::fromUtf8("Nie można otworzyć portu %1").arg(_port));
+        _finish(1);
+        return;
+    }
+
+    if (command == "version") {
+        _version();
+    }
+    else if (command == "read-map") {
+        _readMap(args.value(0));
+    }
+    else if ((command == "write-map") && (args.count() == 1)) {
+        _writeMap(args.at(0));
+    }
+    else if (command == "read-params") {
+        _readParams();
+    }
+    else if ((command == "write-params") && (!args.isEmpty())) {
+        _writeParams(args);
+    }
+    else if (command == "read-keys") {
+        _readKeys();
+    }
+    else if ((command == "write-keys") && (args.count() == 2)) {
+        _writeKeys(args.at(0), args.at(1));
+    }
+    else if ((command == "log") && (!args.isEmpty())) {
+        _log(args.at(0), args.value(1, "0").toInt());
+    }
+    else if (command == "bench") {
+        _bench(args.value(0, QString::number(ECUCLI_BENCH_COMMANDS)).toInt());
+    }
+    else {
+        usage();
+        _finish(1);
+    }
+}
+
+void EcuCli::_command(const QByteArray & command, EcuLink::Callback callback, int retries) {
+    _link->command(command, callback, _timeout, retries);
+}
+
+/* Błąd polecenia na stderr i koniec z kodem 1, true - polecenie wykonane */
+bool EcuCli::_check(const EcuReply & reply, const QString & what) {
+    if (!reply.ok) {
+        cli_error(QString::fromUtf8("%1: brak odpowiedzi ECU (timeout)").arg(what));
+        _finish(1);
+        return false;
+    }
+
+    if (reply.exitCode != 0) {
+        cli_error(QString::fromUtf8("%1: %2").arg(what).arg(EcuProtocol::errorText(reply.exitCode)));
+        _finish(1);
+        return false;
+    }
+
+    return true;
+}
+
+void EcuCli::_finish(int code) {
+    _timer->stop();
+    _logThread->close();
+    _link->close();
+    QCoreApplication::exit(code);
+}
+
+void EcuCli::_portError() {
+    cli_error(QString::fromUtf8("Błąd portu %1").arg(_port));
+    _finish(1);
+}
+
+void EcuCli::_version() {
+    _command(ECU_CMD_VERSION, [this](const EcuReply & reply) {
+        if (!_check(reply, QString::fromUtf8("Wersja"))) {
+            return;
+        }
+
+        cli_print(QString(reply.data.trimmed()) + "\n");
+        _finish(0);
+    });
+}
+
+void EcuCli::_readMap(const QString & fileName) {
+    QSharedPointer<EcuMapFile> map(new EcuMapFile);
+
+    _command(ECU_CMD_READ_AXES, [this, map](const EcuReply & reply) {
+        if (!_check(reply, QString::fromUtf8("Odczyt osi mapy"))) {
+            return;
+        }
+
+        if (!EcuProtocol::parseAxes(reply.data, &map->rpmAxis, &map->loadAxis)) {
+            cli_error(QString::fromUtf8("Odczyt osi mapy: nieprawidłowa odpowiedź"));
+            _finish(1);
+        }
+    });
+
+    _command(ECU_CMD_READ_MAP, [this, map, fileName](const EcuReply & reply) {
+        if (!_check(reply, QString::fromUtf8("Odczyt mapy"))) {
+            return;
+        }
+
+        if (!EcuProtocol::parseMap(reply.data, &map->cells)) {
+            cli_error(QString::fromUtf8("Odczyt mapy: nieprawidłowa odpowiedź"));
+            _finish(1);
+            return;
+        }
+
+        if (fileName.isEmpty()) {
+            cli_print(map->toText());
+        }
+        else if (!map->save(fileName)) {
+            cli_error(QString::fromUtf8("Nie można zapisać pliku %1").arg(fileName));
+            _finish(1);
+            return;
+        }
+
+        _finish(0);
+    });
+}
+
+/* Osie, potem mapa z CRC (bez powtórzeń, jak w diag-app), na końcu odczyt i porównanie */
+void EcuCli::_writeMap(const QString & fileName) {
+    EcuMapFile map;
+    QString error;
+
+    if (!map.load(fileName, &error)) {
+        cli_error(QString("%1: %2").arg(fileName).arg(error));
+        _finish(1);
+        return;
+    }
+
+    _command(EcuProtocol::writeAxesCommand(map.rpmAxis, map.loadAxis), [this, map](const EcuReply & reply) {
+        if (!_check(reply, QString::fromUtf8("Zapis osi mapy"))) {
+            return;
+        }
+
+        _command(EcuProtocol::writeMapCommand(map.cells), [this, map](const EcuReply & reply) {
+            if (!_check(reply, QString::fromUtf8("Zapis mapy"))) {
+                return;
+            }
+
+            _command(ECU_CMD_READ_MAP, [this, map](const EcuReply & reply) {
+                QVector<int> cells;
+
+                if (!_check(reply, QString::fromUtf8("Odczyt mapy"))) {
+                    return;
+                }
+
+                if ((!EcuProtocol::parseMap(reply.data, &cells)) || (cells != map.cells)) {
+                    cli_error(QString::fromUtf8("Mapa odczytana z ECU różni się od zapisanej"));
+                    _finish(1);
+                    return;
+                }
+
+                cli_print(QString::fromUtf8("Zapisano mapę (%1 B)\n").arg(EcuProtocol::writeMapCommand(map.cells).size()));
+                _finish(0);
+            });
+        }, 0);
+    });
+}
+
+void EcuCli::_readParams() {
+    _command(ECU_CMD_READ_PARAMS, [this](const EcuReply & reply) {
+        QVector<uint16_t> params;
+
+        if (!_check(reply, QString::fromUtf8("Odczyt parametrów"))) {
+            return;
+        }
+
+        if (!EcuProtocol::parseParams(reply.data, &params)) {
+            cli_error(QString::fromUtf8("Odczyt parametrów: nieprawidłowa odpowiedź"));
+            _finish(1);
+            return;
+        }
+
+        for(int i = 0; i < PARAM_COUNT; i++) {
+            cli_print(QString("%1 %2 %3\n").arg(i).arg(_paramNames[i]).arg(params.at(i)));
+        }
+        _finish(0);
+    });
+}
+
+/* Odczyt wszystkich parametrów, zmiana podanych i zapis jednym poleceniem 'S' */
+void EcuCli::_writeParams(const QStringList & assignments) {
+    QVector<int> changes(PARAM_COUNT, -1);
+
+    foreach (const QString & assignment, assignments) {
+        QString name = assignment.section('=', 0, 0);
+        bool numeric, ok;
+        int index = name.toInt(&numeric);
+        int value = assignment.section('=', 1).toInt(&ok, 0);
+
+        if (!numeric) {
+            index = -1;
+            for(int i = 0; i < PARAM_COUNT; i++) {
+                if (name == _paramNames[i]) {
+                    index = i;
+                }
+            }
+        }
+
+        if ((!assignment.contains('=')) || (index < 0) || (index >= PARAM_COUNT) || (!ok) || (value < 0) || (value > 0xFFFF)) {
+            cli_error(QString::fromUtf8("Nieprawidłowy parametr: %1").arg(assignment));
+            _finish(1);
+            return;
+        }
+
+        changes[index] = value;
+    }
+
+    _command(ECU_CMD_READ_PARAMS, [this, changes](const EcuReply & reply) {
+        QVector<uint16_t> params;
+
+        if (!_check(reply, QString::fromUtf8("Odczyt parametrów"))) {
+            return;
+        }
+
+        if (!EcuProtocol::parseParams(reply.data, &params)) {
+            cli_error(QString::fromUtf8("Odczyt parametrów: nieprawidłowa odpowiedź"));
+            _finish(1);
+            return;
+        }
+
+        for(int i = 0; i < PARAM_COUNT; i++) {
+            if (changes.at(i) >= 0) {
+                params[i] = changes.at(i);
+            }
+        }
+
+        _command(EcuProtocol::writeParamsCommand(params), [this](const EcuReply & reply) {
+            if (_check(reply, QString::fromUtf8("Zapis parametrów"))) {
+                _finish(0);
+            }
+        });
+    });
+}
+
+void EcuCli::_readKeys() {
+    _command(ECU_CMD_READ_KEYS, [this](const EcuReply & reply) {
+        QStringList keys;
+
+        if (!_check(reply, QString::fromUtf8("Odczyt kodów immobilizera"))) {
+            return;
+        }
+
+        keys = EcuProtocol::parseKeys(reply.data);
+        for(int i = 0; i < IMMO_KEYS; i++) {
+            cli_print(QString("%1 %2\n").arg(i).arg(keys.value(i)));
+        }
+        _finish(0);
+    });
+}
+
+void EcuCli::_writeKeys(const QString & key0, const QString & key1) {
+    if ((key0.length() > IMMO_KEY_LEN) || (key1.length() > IMMO_KEY_LEN)) {
+        cli_error(QString::fromUtf8("Kod immobilizera ma najwyżej %1 znaków").arg(IMMO_KEY_LEN));
+        _finish(1);
+        return;
+    }
+
+    _command(EcuProtocol::writeKeysCommand(key0, key1), [this](const EcuReply & reply) {
+        if (_check(reply, QString::fromUtf8("Zapis kodów immobilizera"))) {
+            _finish(0);
+        }
+    });
+}
+
+/*
+ * Log binarny z transmisji co obrót. Ramki trafiają do kolejki LogThread
+ * (zapis w osobnym wątku), co ECUCLI_STATS_PERIOD ms na stderr wypisywane są
+ * próbki/s, kB/s, próbki odrzucone i utracone przy błędzie zapisu (wtedy kod
+ * wyjścia 1).
+ */
+void EcuCli::_log(const QString & fileName, int seconds) {
+    if (!_logThread->open(fileName)) {
+        cli_error(QString::fromUtf8("Nie można otworzyć pliku %1 do zapisu").arg(fileName));
+        _finish(1);
+        return;
+    }
+
+    _duration = seconds * 1000LL;
+    _lastStats = 0;
+    _stats = _logThread->stats();
+    _interrupted = 0;
+    signal(SIGINT, cli_sigint);
+
+    _command(EcuProtocol::streamCommand(STREAM_EVERY_REVOLUTION), [this](const EcuReply & reply) {
+        if (!_check(reply, QString::fromUtf8("Włączenie transmisji"))) {
+            return;
+        }
+
+        _clock.start();
+        _timer->start();
+    });
+}
+
+void EcuCli::_frameReceived(const EcuFrame & frame) {
+    LiveData live;
+
+    if ((!_logThread->isOpen()) || (!LiveData::fromFrame(frame, &live))) {
+        return;
+    }
+
+    _frames++;
+    _logThread->push(EcuProtocol::logSample(live, _logThread->elapsed()));
+}
+
+/* Co ECUCLI_STATS_PERIOD / 10 ms - koniec logowania, co ECUCLI_STATS_PERIOD ms statystyki */
+void EcuCli::_logStats() {
+    LogThreadStats stats;
+
+    if ((_interrupted) || ((_duration) && (_clock.elapsed() >= _duration))) {
+        _stopLog();
+        return;
+    }
+
+    if (_clock.elapsed() - _lastStats < ECUCLI_STATS_PERIOD) {
+        return;
+    }
+    _lastStats = _clock.elapsed();
+
+    stats = _logThread->stats();
+    cli_error(QString::fromUtf8("%1 s: %2 próbek/s, %3 kB/s, odrzucone: %4, błędy zapisu: %5, CRC: %6")
+              .arg(_lastStats / 1000)
+              .arg(stats.written - _stats.written)
+              .arg((stats.bytes - _stats.bytes) / 1024.0, 0, 'f', 1)
+              .arg(stats.dropped)
+              .arg(stats.failed)
+              .arg(_link->crcErrors()));
+    _stats = stats;
+}
+
+void EcuCli::_stopLog() {
+    _timer->stop();
+    signal(SIGINT, SIG_DFL);
+
+    _command(EcuProtocol::streamCommand(STREAM_OFF), [this](const EcuReply & reply) {
+        LogThreadStats stats;
+        qint64 elapsed = qMax(_clock.elapsed(), (qint64)1);
+
+        _logThread->close();
+        stats = _logThread->stats();
+        cli_print(QString::fromUtf8("Zapisano %1 próbek w %2 s (%3 ramek/s), %4 B, odrzucone: %5, błędy zapisu: %6, CRC: %7\n")
+                  .arg(stats.written)
+                  .arg(elapsed / 1000.0, 0, 'f', 1)
+                  .arg(_frames * 1000.0 / elapsed, 0, 'f', 1)
+                  .arg(stats.bytes)
+                  .arg(stats.dropped)
+                  .arg(stats.failed)
+                  .arg(_link->crcErrors()));
+
+        if (_check(reply, QString::fromUtf8("Wyłączenie transmisji"))) {
+            _finish((stats.dropped || stats.failed) ? 1 : 0);
+        }
+    });
+}
+
+/* count poleceń 'd' naraz (EcuLink wysyła po ECULINK_WINDOW), opóźnienia ze statystyk EcuLink */
+void EcuCli::_bench(int count) {
+    QSharedPointer<int> left(new int(count));
+
+    if (count <= 0) {
+        usage();
+        _finish(1);
+        return;
+    }
+
+    _link->resetStats();
+    _clock.start();
+
+    for(int i = 0; i < count; i++) {
+        _command(ECU_CMD_LIVE_DATA, [this, left](const EcuReply & reply) {
+            const EcuLinkStats & stats = _link->stats();
+            qint64 elapsed;
+
+            (void)reply;
+            if (--(*left) > 0) {
+                return;
+            }
+
+            elapsed = qMax(_clock.nsecsElapsed() / 1000, (qint64)1);
+            cli_print(QString::fromUtf8("%1 poleceń w %2 ms (%3 /s), odpowiedź: śr. %4 ms (min %5, max %6), timeout: %7 (powt. %8, błędy %9)\n")
+                      .arg(stats.replies)
+                      .arg(elapsed / 1000.0, 0, 'f', 1)
+                      .arg(stats.replies * 1000000.0 / elapsed, 0, 'f', 1)
+                      .arg(stats.replies ? stats.totalLatency / (double)stats.replies / 1000.0 : 0.0, 0, 'f', 2)
+                      .arg(stats.minLatency / 1000.0, 0, 'f', 2)
+                      .arg(stats.maxLatency / 1000.0, 0, 'f', 2)
+                      .arg(stats.timeouts)
+                      .arg(stats.retries)
+                      .arg(stats.failures));
+            _finish(stats.failures ? 1 : 0);
+        });
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef ECUCLI_H
+#define ECUCLI_H
+
+#include <QObject>
+#include <QStringList>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QVector>
+#include "eculink.h"
+#include "ecuprotocol.h"
+#include "logthread.h"
+
+#define ECUCLI_BENCH_COMMANDS    1000 /* Domyślna ilość poleceń 'd' w teście opóźnień */
+#define ECUCLI_STATS_PERIOD      1000 /* Okres wypisywania statystyk logu [ms] */
+
+/* Mapa z osiami w pliku tekstowym (read-map / write-map) */
+struct EcuMapFile {
+    QList<int> rpmAxis;
+    QList<int> loadAxis;
+    QVector<int> cells; /* MAP_ROWS * MAP_RPM_SIZE */
+
+    bool load(const QString & fileName, QString * error);
+    bool save(const QString & fileName) const;
+    QString toText(void) const;
+};
+
+/*
+ * Diagnostyka ECU z linii poleceń (bez GUI) - te same EcuLink i EcuProtocol
+ * co w diag-app. Polecenie wykonywane jest asynchronicznie w pętli zdarzeń,
+ * na końcu QCoreApplication::exit() z kodem wyjścia (0 - OK, 1 - błąd).
+ */
+class EcuCli : public QObject {
+    Q_OBJECT
+
+public:
+    explicit EcuCli(const QStringList & args, QObject * parent = 0);
+    ~EcuCli();
+
+    static void usage(void);
+
+public slots:
+    void start(void);
+
+private slots:
+    void _frameReceived(const EcuFrame & frame);
+    void _portError(void);
+    void _logStats(void);
+
+private:
+    QStringList _args;
+    QString _port;
+    int _timeout;
+    EcuLink * _link;
+    LogThread * _logThread;
+    QTimer * _timer;
+    QElapsedTimer _clock;
+    qint64 _duration;  /* Czas logowania [ms], 0 - do Ctrl+C */
+    qint64 _lastStats; /* Czas ostatnich statystyk logu [ms] */
+    LogThreadStats _stats;
+    quint64 _frames;
+
+    void _command(const QByteArray & command, EcuLink::Callback callback, int retries = ECULINK_RETRIES);
+    bool _check(const EcuReply & reply, const QString & what);
+    void _finish(int code);
+
+    void _version(void);
+    void _readMap(const QString & fileName);
+    void _writeMap(const QString & fileName);
+    void _readParams(void);
+    void _writeParams(const QStringList & assignments);
+    void _readKeys(void);
+    void _writeKeys(const QString & key0, const QString & key1);
+    void _log(const QString & fileName, int seconds);
+    void _stopLog(void);
+    void _bench(int count);
+};
+
+#endif // ECUCLI_H
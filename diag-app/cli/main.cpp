@@ -0,0 +1,13 @@
+#include "ecucli.h"
+#include <QCoreApplication>
+#include <QTimer>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    EcuCli cli(a.arguments().mid(1));
+
+    QTimer::singleShot(0, &cli, SLOT(start()));
+
+    return a.exec();
+}
@@ -5,16 +5,21 @@
 #-------------------------------------------------
 
 QT       += core gui
-QT       += serialport
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 TARGET = diag-app
 TEMPLATE = app
 
+include(ecuproto.pri)
+
 SOURCES += main.cpp\
-        wndmain.cpp
+        wndmain.cpp \
+        plotbuffer.cpp \
+        plotwidget.cpp
 
-HEADERS  += wndmain.h
+HEADERS  += wndmain.h \
+        plotbuffer.h \
+        plotwidget.h
 
 FORMS    += wndmain.ui
@@ -0,0 +1,15 @@
+#-------------------------------------------------
+#
+# diag-app (GUI) i ecu-cli (linia poleceń) - wspólna komunikacja z ECU
+# w ecuproto.pri, każdy program budowany osobno
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS = app cli
+
+app.file = diag-app.pro
+app.makefile = Makefile.diag-app
+
+cli.file = cli/ecu-cli.pro
@@ -0,0 +1,98 @@
+#include "ecuframe.h"
+
+static inline uint16_t le16(const QByteArray & data, int pos) {
+    return (uint8_t)data.at(pos) | ((uint8_t)data.at(pos + 1) << 8);
+}
+
+bool LiveData::fromFrame(const EcuFrame & frame, LiveData * data) {
+    if ((frame.type != FRAME_LIVE_DATA) || (frame.payload.size() < 14)) {
+        return false;
+    }
+
+    data->seq = frame.payload.at(0);
+    data->timestamp = le16(frame.payload, 1);
+    data->rpm = le16(frame.payload, 3);
+    data->advance = le16(frame.payload, 5);
+    data->acceleration = le16(frame.payload, 7);
+    data->throttle = le16(frame.payload, 9);
+    data->temp = le16(frame.payload, 11);
+    data->flags = frame.payload.at(13);
+    return true;
+}
+
+EcuFrameDecoder::EcuFrameDecoder() {
+    reset();
+}
+
+void EcuFrameDecoder::reset() {
+    _buffer.clear();
+    _frames.clear();
+    _crcErrors = 0;
+}
+
+/* CRC16-CCITT, to samo co _crc_ccitt_update z avr-libc */
+uint16_t EcuFrameDecoder::crc16(uint16_t crc, uint8_t data) {
+    data ^= crc & 0xFF;
+    data ^= data << 4;
+
+    return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^ ((uint16_t)data << 3));
+}
+
+/* Dopisuje dane z ECU, zwraca tekst (wszystko poza ramkami), ramki odbiera się przez takeFrame() */
+QByteArray EcuFrameDecoder::feed(const QByteArray & data) {
+    QByteArray text;
+    int sync, length;
+    uint16_t crc;
+
+    _buffer.append(data);
+
+    while (!_buffer.isEmpty()) {
+        sync = _buffer.indexOf((char)FRAME_SYNC);
+        if (sync < 0) {
+            text.append(_buffer);
+            _buffer.clear();
+            break;
+        }
+
+        text.append(_buffer.left(sync));
+        _buffer.remove(0, sync);
+
+        if (_buffer.size() < 3) { /* Niepełny nagłówek */
+            break;
+        }
+
+        length = (uint8_t)_buffer.at(2);
+        if (_buffer.size() < length + 5) { /* Niepełna ramka */
+            break;
+        }
+
+        crc = 0xFFFF;
+        for(int i = 1; i < length + 3; i++) {
+            crc = crc16(crc, _buffer.at(i));
+        }
+
+        if (crc != le16(_buffer, length + 3)) { /* Uszkodzona ramka - szukamy następnego bajtu synchronizacji */
+            _crcErrors++;
+            _buffer.remove(0, 1);
+            continue;
+        }
+
+        EcuFrame frame;
+        frame.type = _buffer.at(1);
+        frame.payload = _buffer.mid(3, length);
+        _frames.append(frame);
+
+        _buffer.remove(0, length + 5);
+    }
+
+    return text;
+}
+
+bool EcuFrameDecoder::takeFrame(EcuFrame * frame) {
+    if (_frames.isEmpty()) {
+        return false;
+    }
+
+    *frame = _frames.takeFirst();
+    return true;
+}
@@ -0,0 +1,58 @@
+#ifndef ECUFRAME_H
+#define ECUFRAME_H
+
+#include <QByteArray>
+#include <QList>
+#include <stdint.h>
+
+/* Ramki binarne ECU (patrz src/interface.h) */
+#define FRAME_SYNC              0xA5
+#define FRAME_LIVE_DATA         0x01
+
+#define STREAM_OFF              0x0000
+#define STREAM_EVERY_REVOLUTION 0xFFFF
+
+#define ECU_FLAG_DYNAMIC        (1 << 0)
+#define ECU_FLAG_CUT_OFF        (1 << 1)
+#define ECU_FLAG_IMMO_LOCKED    (1 << 2)
+#define ECU_FLAG_LIMIT          (1 << 3)
+
+struct EcuFrame {
+    uint8_t type;
+    QByteArray payload;
+};
+
+/* Dane na żywo (ramka FRAME_LIVE_DATA lub odpowiedź na polecenie 'd') */
+struct LiveData {
+    uint8_t seq;
+    uint16_t timestamp;
+    uint16_t rpm;
+    int16_t advance;
+    int16_t acceleration;
+    uint16_t throttle;
+    int16_t temp;
+    uint8_t flags;
+
+    static bool fromFrame(const EcuFrame & frame, LiveData * data);
+};
+
+/* Wydziela ramki binarne ze strumienia z ECU, reszta to odpowiedzi tekstowe */
+class EcuFrameDecoder {
+public:
+    EcuFrameDecoder();
+
+    QByteArray feed(const QByteArray & data);
+    bool takeFrame(EcuFrame * frame);
+    void reset(void);
+
+    uint32_t crcErrors(void) const { return _crcErrors; }
+
+    static uint16_t crc16(uint16_t crc, uint8_t data);
+
+private:
+    QByteArray _buffer;
+    QList<EcuFrame> _frames;
+    uint32_t _crcErrors;
+};
+
+#endif // ECUFRAME_H
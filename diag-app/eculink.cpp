@@ -0,0 +1,241 @@
+#include "eculink.h"
+#include <ctype.h>
+
+EcuLink::EcuLink(QObject * parent) : QObject(parent) {
+    _serial = new QSerialPort(this);
+    connect(_serial, SIGNAL(readyRead()), this, SLOT(_readyRead()));
+    connect(_serial, SIGNAL(error(QSerialPort::SerialPortError)), this, SLOT(_serialError(QSerialPort::SerialPortError)));
+
+    _timer = new QTimer(this);
+    _timer->setSingleShot(true);
+    connect(_timer, SIGNAL(timeout()), this, SLOT(_timeout()));
+
+    _resync = false;
+    resetStats();
+}
+
+EcuLink::~EcuLink() {
+    close();
+}
+
+bool EcuLink::open(const QSerialPortInfo & port) {
+    close();
+
+    _serial->setPort(port);
+    return _open();
+}
+
+/* Port po nazwie albo ścieżce (np. pseudoterminal emulatora ECU z ecu-sim) */
+bool EcuLink::open(const QString & portName) {
+    close();
+
+    _serial->setPortName(portName);
+    return _open();
+}
+
+bool EcuLink::_open() {
+    _serial->setBaudRate(9600);
+    if (!_serial->open(QIODevice::ReadWrite)) {
+        return false;
+    }
+
+    _serial->clear();
+    return true;
+}
+
+/* Zamknięcie portu, polecenia w kolejce są porzucane (bez wywołania callbacków) */
+void EcuLink::close() {
+    if (_serial->isOpen()) {
+        _serial->close();
+    }
+
+    _timer->stop();
+    _queue.clear();
+    _inFlight.clear();
+    _text.clear();
+    _decoder.reset();
+    _resync = false;
+}
+
+bool EcuLink::isOpen() const {
+    return _serial->isOpen();
+}
+
+void EcuLink::resetStats() {
+    _stats.replies = 0;
+    _stats.timeouts = 0;
+    _stats.retries = 0;
+    _stats.failures = 0;
+    _stats.minLatency = 0;
+    _stats.maxLatency = 0;
+    _stats.totalLatency = 0;
+}
+
+/* Dodanie polecenia do kolejki, callback wywoływany po odpowiedzi lub po ostatnim nieudanym powtórzeniu */
+void EcuLink::command(const QByteArray & command, Callback callback, int timeout, int retries) {
+    Request request;
+
+    request.command = command;
+    request.callback = callback;
+    request.timeout = timeout;
+    request.retries = retries;
+
+    _queue.append(request);
+    _send();
+}
+
+/* Wysłanie poleceń z kolejki (najwyżej ECULINK_WINDOW oczekujących na odpowiedź) */
+void EcuLink::_send() {
+    if ((!_serial->isOpen()) || (_resync)) {
+        return;
+    }
+
+    while ((!_queue.isEmpty()) && (_inFlight.count() < ECULINK_WINDOW)) {
+        Request request = _queue.takeFirst();
+
+        request.sent.start();
+        _serial->write(request.command);
+        _inFlight.append(request);
+
+        if (_inFlight.count() == 1) {
+            _armTimer();
+        }
+    }
+}
+
+/* Czas na odpowiedź na najstarsze wysłane polecenie */
+void EcuLink::_armTimer() {
+    if (_inFlight.isEmpty()) {
+        _timer->stop();
+        return;
+    }
+
+    _timer->start(qMax((qint64)0, _inFlight.first().timeout - _inFlight.first().sent.elapsed()));
+}
+
+/* Pozycja '>' promptu "\r\nxx>" w odebranym tekście, -1 gdy brak */
+int EcuLink::_findPrompt() const {
+    int pos = 0;
+
+    while ((pos = _text.indexOf('>', pos)) >= 0) {
+        if ((pos >= 4) && (_text.at(pos - 4) == '\r') && (_text.at(pos - 3) == '\n') &&
+            (isxdigit((uint8_t)_text.at(pos - 2))) && (isxdigit((uint8_t)_text.at(pos - 1)))) {
+            return pos;
+        }
+        pos++;
+    }
+
+    return -1;
+}
+
+void EcuLink::_readyRead() {
+    QByteArray text;
+    EcuFrame frame;
+    EcuReply reply;
+    int pos;
+
+    /* Ramki binarne mogą być przeplecione z odpowiedziami, zostawiamy sam tekst */
+    text = _decoder.feed(_serial->readAll());
+
+    while (_decoder.takeFrame(&frame)) {
+        emit frameReceived(frame);
+    }
+
+    if (_resync) { /* Po przekroczeniu czasu czekamy na ciszę, spóźnione odpowiedzi są odrzucane */
+        if (!text.isEmpty()) {
+            _timer->start(ECULINK_RESYNC);
+        }
+        return;
+    }
+
+    _text.append(text);
+
+    while ((_serial->isOpen()) && ((pos = _findPrompt()) >= 0)) {
+        if (_inFlight.isEmpty()) { /* Odpowiedź bez polecenia - pomijamy */
+            _text.remove(0, pos + 1);
+            continue;
+        }
+
+        Request request = _inFlight.takeFirst();
+
+        reply.ok = true;
+        reply.exitCode = _text.mid(pos - 2, 2).toInt(0, 16);
+        reply.data = _text.left(pos - 2);
+        reply.latency = request.sent.nsecsElapsed() / 1000;
+        _text.remove(0, pos + 1);
+
+        _stats.replies++;
+        _stats.totalLatency += reply.latency;
+        if ((_stats.replies == 1) || (reply.latency < _stats.minLatency)) {
+            _stats.minLatency = reply.latency;
+        }
+        if (reply.latency > _stats.maxLatency) {
+            _stats.maxLatency = reply.latency;
+        }
+
+        _armTimer();
+        _send();
+
+        if (request.callback) {
+            request.callback(reply);
+        }
+    }
+}
+
+/*
+ * Brak odpowiedzi na najstarsze polecenie (lub koniec ciszy po resynchronizacji).
+ * Wysłane polecenia wracają na początek kolejki, najstarsze jest powtarzane
+ * albo kończone błędem, a przed ponownym wysłaniem czekamy, aż spóźnione
+ * odpowiedzi przestaną przychodzić (inaczej zostałyby przypisane do złych poleceń).
+ */
+void EcuLink::_timeout() {
+    EcuReply reply;
+
+    if (_resync) {
+        _resync = false;
+        _text.clear();
+        _send();
+        return;
+    }
+
+    if (_inFlight.isEmpty()) {
+        return;
+    }
+
+    _stats.timeouts++;
+
+    Request request = _inFlight.takeFirst();
+    while (!_inFlight.isEmpty()) {
+        _queue.prepend(_inFlight.takeLast());
+    }
+
+    _resync = true;
+    _text.clear();
+    _timer->start(ECULINK_RESYNC);
+
+    if (request.retries > 0) {
+        request.retries--;
+        _stats.retries++;
+        _queue.prepend(request);
+        return;
+    }
+
+    _stats.failures++;
+    if (request.callback) {
+        reply.ok = false;
+        reply.exitCode = 0xFF;
+        reply.latency = request.sent.nsecsElapsed() / 1000;
+        request.callback(reply);
+    }
+}
+
+void EcuLink::_serialError(QSerialPort::SerialPortError error) {
+    if (!_serial->isOpen()) { /* Błąd otwarcia zwraca open() */
+        return;
+    }
+
+    if ((error == QSerialPort::ResourceError) || (error == QSerialPort::DeviceNotFoundError) || (error == QSerialPort::PermissionError)) {
+        close();
+        emit portError();
+    }
+}
@@ -0,0 +1,100 @@
+#ifndef ECULINK_H
+#define ECULINK_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QList>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QtSerialPort/QSerialPort>
+#include <QtSerialPort/QSerialPortInfo>
+#include <functional>
+#include <stdint.h>
+#include "ecuframe.h"
+
+#define ECULINK_TIMEOUT          1000 /* Czas na odpowiedź ECU [ms] */
+#define ECULINK_RETRIES          1    /* Ilość powtórzeń polecenia po przekroczeniu czasu */
+#define ECULINK_WINDOW           4    /* Ilość poleceń wysłanych bez czekania na odpowiedź */
+#define ECULINK_RESYNC           100  /* Cisza na linii przed wznowieniem po przekroczeniu czasu [ms] */
+
+/* Odpowiedź ECU na polecenie */
+struct EcuReply {
+    bool ok;            /* false - brak odpowiedzi (po wszystkich powtórzeniach) lub port zamknięty */
+    uint8_t exitCode;   /* Kod z promptu "xx>" */
+    QByteArray data;    /* Dane odpowiedzi (bez promptu) */
+    qint64 latency;     /* Czas od wysłania do odpowiedzi [us] */
+};
+
+/* Statystyki opóźnień */
+struct EcuLinkStats {
+    quint64 replies;
+    quint64 timeouts;
+    quint64 retries;
+    quint64 failures;
+    qint64 minLatency;  /* [us] */
+    qint64 maxLatency;
+    qint64 totalLatency;
+};
+
+/*
+ * Kolejka poleceń do ECU obsługiwana asynchronicznie (readyRead, bez czekania
+ * w wątku GUI). Do ECULINK_WINDOW poleceń jest wysyłanych naraz, ECU wykonuje
+ * je po kolei, więc odpowiedzi przypisywane są w kolejności wysłania po
+ * prompcie "xx>". Ramki binarne są wydzielane ze strumienia i przekazywane
+ * sygnałem frameReceived().
+ */
+class EcuLink : public QObject {
+    Q_OBJECT
+
+public:
+    typedef std::function<void (const EcuReply & reply)> Callback;
+
+    explicit EcuLink(QObject * parent = 0);
+    ~EcuLink();
+
+    bool open(const QSerialPortInfo & port);
+    bool open(const QString & portName);
+    void close(void);
+    bool isOpen(void) const;
+
+    void command(const QByteArray & command, Callback callback = Callback(), int timeout = ECULINK_TIMEOUT, int retries = ECULINK_RETRIES);
+    int pending(void) const { return _queue.count() + _inFlight.count(); }
+
+    const EcuLinkStats & stats(void) const { return _stats; }
+    void resetStats(void);
+    uint32_t crcErrors(void) const { return _decoder.crcErrors(); }
+
+signals:
+    void frameReceived(const EcuFrame & frame);
+    void portError(void);
+
+private slots:
+    void _readyRead(void);
+    void _timeout(void);
+    void _serialError(QSerialPort::SerialPortError error);
+
+private:
+    struct Request {
+        QByteArray command;
+        Callback callback;
+        int timeout;
+        int retries;
+        QElapsedTimer sent;
+    };
+
+    QSerialPort * _serial;
+    QTimer * _timer;
+    EcuFrameDecoder _decoder;
+    QList<Request> _queue;
+    QList<Request> _inFlight;
+    QByteArray _text;
+    bool _resync;
+    EcuLinkStats _stats;
+
+    bool _open(void);
+    void _send(void);
+    void _armTimer(void);
+    int _findPrompt(void) const;
+};
+
+#endif // ECULINK_H
@@ -0,0 +1,458 @@
+#include "eculog.h"
+#include "ecuframe.h"
+#include <string.h>
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#define ECULOG_MAGIC            "ETZLOG01"
+#define ECULOG_HEADER           24
+#define ECULOG_CHUNK_MAGIC      0x4B4E4843 /* "CHNK" */
+#define ECULOG_CHUNK_HEADER     32
+#define ECULOG_INDEX_MAGIC      0x58444E49 /* "INDX" */
+#define ECULOG_INDEX_ENTRY      24
+#define ECULOG_TRAILER          16
+
+static inline void put16(QByteArray & out, quint16 value) {
+    out.append((char)(value & 0xFF));
+    out.append((char)(value >> 8));
+}
+
+static inline void put32(QByteArray & out, quint32 value) {
+    put16(out, value & 0xFFFF);
+    put16(out, value >> 16);
+}
+
+static inline void put64(QByteArray & out, quint64 value) {
+    put32(out, value & 0xFFFFFFFF);
+    put32(out, value >> 32);
+}
+
+static inline quint16 get16(const uchar * data) {
+    return data[0] | (data[1] << 8);
+}
+
+static inline quint32 get32(const uchar * data) {
+    return get16(data) | ((quint32)get16(data + 2) << 16);
+}
+
+static inline quint64 get64(const uchar * data) {
+    return get32(data) | ((quint64)get32(data + 4) << 32);
+}
+
+/* Różnica ze znakiem jako varint (zigzag - małe wartości obu znaków zajmują mało bajtów) */
+static inline void putDelta(QByteArray & out, qint64 delta) {
+    quint64 value = ((quint64)delta << 1) ^ (quint64)(delta >> 63);
+
+    while (value >= 0x80) {
+        out.append((char)((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.append((char)value);
+}
+
+/* Zwraca false przy końcu danych lub zbyt długim varincie */
+static inline bool getDelta(const uchar ** pos, const uchar * end, qint64 * delta) {
+    quint64 value = 0;
+    int shift = 0;
+
+    do {
+        if ((*pos >= end) || (shift > 63)) {
+            return false;
+        }
+
+        value |= (quint64)(**pos & 0x7F) << shift;
+        shift += 7;
+    } while (*(*pos)++ & 0x80);
+
+    *delta = (qint64)(value >> 1) ^ -(qint64)(value & 1);
+    return true;
+}
+
+static quint16 crc16(const uchar * data, quint32 size) {
+    quint16 crc = 0xFFFF;
+
+    for(quint32 i = 0; i < size; i++) {
+        crc = EcuFrameDecoder::crc16(crc, data[i]);
+    }
+
+    return crc;
+}
+
+LogWriter::LogWriter() {
+    _chunks = 0;
+    _lost = 0;
+}
+
+LogWriter::~LogWriter() {
+    close();
+}
+
+bool LogWriter::open(const QString & fileName) {
+    QByteArray header(ECULOG_MAGIC);
+
+    close();
+
+    _file.setFileName(fileName);
+    if (!_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+
+    put16(header, ECULOG_VERSION);
+    put16(header, LOG_CHANNELS);
+    put32(header, 0);
+    put64(header, QDateTime::currentDateTimeUtc().toMSecsSinceEpoch());
+
+    _chunk.clear();
+    _chunk.reserve(ECULOG_CHUNK_SAMPLES);
+    _index.clear();
+    _chunks = 0;
+    _lost = 0;
+    _clock.start();
+
+    return _file.write(header) == header.size();
+}
+
+/* Zapis ostatniej paczki i indeksu */
+void LogWriter::close() {
+    QByteArray trailer;
+    qint64 offset;
+
+    if (!_file.isOpen()) {
+        return;
+    }
+
+    flush();
+
+    offset = _file.pos();
+    put64(trailer, offset);
+    put32(trailer, _chunks);
+    put32(trailer, ECULOG_INDEX_MAGIC);
+    _file.write(_index);
+    _file.write(trailer);
+    _file.close();
+}
+
+/* Próbka do paczki, pełna paczka zapisywana jest od razu */
+bool LogWriter::append(const LogSample & sample) {
+    if (!_file.isOpen()) {
+        return false;
+    }
+
+    _chunk.append(sample);
+    if (_chunk.count() >= ECULOG_CHUNK_SAMPLES) {
+        return flush();
+    }
+
+    return true;
+}
+
+/* Zapis zebranych próbek jako paczki (kolumnami, różnice względem poprzedniej wartości) */
+bool LogWriter::flush() {
+    QByteArray header, data;
+    qint64 prev, offset;
+
+    if ((!_file.isOpen()) || (_chunk.isEmpty())) {
+        return true;
+    }
+
+    prev = _chunk.first().time;
+    for(int i = 0; i < _chunk.count(); i++) {
+        putDelta(data, _chunk.at(i).time - prev);
+        prev = _chunk.at(i).time;
+    }
+
+    for(int ch = 0; ch < LOG_CHANNELS; ch++) {
+        prev = 0;
+        for(int i = 0; i < _chunk.count(); i++) {
+            putDelta(data, (qint64)_chunk.at(i).values[ch] - prev);
+            prev = _chunk.at(i).values[ch];
+        }
+    }
+
+    put32(header, ECULOG_CHUNK_MAGIC);
+    put32(header, _chunk.count());
+    put64(header, _chunk.first().time);
+    put64(header, _chunk.last().time);
+    put32(header, data.size());
+    put16(header, crc16((const uchar *)data.constData(), data.size()));
+    put16(header, 0);
+
+    offset = _file.pos();
+    if ((_file.write(header) != header.size()) || (_file.write(data) != data.size())) {
+        _lost += _chunk.count();
+        _chunk.clear(); /* Niepełny blok nie trafia do indeksu */
+        return false;
+    }
+
+    put64(_index, offset);
+    put64(_index, _chunk.first().time);
+    put32(_index, _chunk.count());
+    put32(_index, 0);
+    _chunks++;
+
+    _chunk.clear();
+    return true;
+}
+
+/* Zapis niepełnej paczki i wymuszenie zapisu na nośnik (po awarii zostaje plik bez indeksu do tego miejsca) */
+bool LogWriter::sync() {
+    if (!_file.isOpen()) {
+        return false;
+    }
+
+    if ((!flush()) || (!_file.flush())) {
+        return false;
+    }
+
+#ifdef Q_OS_WIN
+    return _commit(_file.handle()) == 0;
+#else
+    return fsync(_file.handle()) == 0;
+#endif
+}
+
+LogReader::LogReader() {
+    _data = NULL;
+    _size = 0;
+    _count = 0;
+    _duration = 0;
+}
+
+LogReader::~LogReader() {
+    close();
+}
+
+bool LogReader::isBinaryLog(const QString & fileName) {
+    QFile file(fileName);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    return file.read(8) == QByteArray(ECULOG_MAGIC);
+}
+
+bool LogReader::open(const QString & fileName) {
+    close();
+
+    _file.setFileName(fileName);
+    if (!_file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    _size = _file.size();
+    if (_size >= ECULOG_HEADER) {
+        _data = _file.map(0, _size);
+    }
+
+    if ((!_data) || (memcmp(_data, ECULOG_MAGIC, 8)) || (get16(_data + 8) != ECULOG_VERSION) || (get16(_data + 10) != LOG_CHANNELS)) {
+        close();
+        return false;
+    }
+
+    _start = QDateTime::fromMSecsSinceEpoch(get64(_data + 16));
+    if (!_loadIndex()) {
+        _scanChunks();
+    }
+
+    _count = 0;
+    for(int i = 0; i < _index.count(); i++) {
+        _count += _index.at(i).count;
+    }
+
+    _duration = _index.isEmpty() ? 0 : get64(_data + _index.last().offset + 16);
+    return true;
+}
+
+void LogReader::close() {
+    if (_data) {
+        _file.unmap((uchar *)_data);
+        _data = NULL;
+    }
+
+    if (_file.isOpen()) {
+        _file.close();
+    }
+
+    _index.clear();
+    _size = 0;
+    _count = 0;
+    _duration = 0;
+}
+
+/* Nagłówek paczki pod offset (zakres i CRC danych), przy poprawnym wypełnia chunk */
+bool LogReader::_checkChunk(qint64 offset, Chunk * chunk) const {
+    const uchar * header = _data + offset;
+    quint32 size, count;
+
+    if ((offset < ECULOG_HEADER) || (offset + ECULOG_CHUNK_HEADER > _size) || (get32(header) != ECULOG_CHUNK_MAGIC)) {
+        return false;
+    }
+
+    size = get32(header + 24);
+    if ((offset + ECULOG_CHUNK_HEADER + size > _size) || (crc16(header + ECULOG_CHUNK_HEADER, size) != get16(header + 28))) {
+        return false;
+    }
+
+    /* CRC nie obejmuje nagłówka - ilość próbek musi się zmieścić w danych (co najmniej bajt na wartość) */
+    count = get32(header + 4);
+    if ((count > ECULOG_CHUNK_SAMPLES) || ((quint64)count * (1 + LOG_CHANNELS) > size)) {
+        return false;
+    }
+
+    chunk->offset = offset;
+    chunk->time = get64(header + 8);
+    chunk->count = count;
+    return true;
+}
+
+/* Indeks z końca pliku, false gdy go nie ma (zapis przerwany przed close()) */
+bool LogReader::_loadIndex() {
+    const uchar * trailer = _data + _size - ECULOG_TRAILER;
+    qint64 offset;
+    quint32 chunks;
+
+    if ((_size < ECULOG_HEADER + ECULOG_TRAILER) || (get32(trailer + 12) != ECULOG_INDEX_MAGIC)) {
+        return false;
+    }
+
+    offset = get64(trailer);
+    chunks = get32(trailer + 8);
+    if ((offset < ECULOG_HEADER) || (offset + (qint64)chunks * ECULOG_INDEX_ENTRY + ECULOG_TRAILER != _size)) {
+        return false;
+    }
+
+    _index.resize(chunks);
+    for(quint32 i = 0; i < chunks; i++) {
+        const uchar * entry = _data + offset + i * ECULOG_INDEX_ENTRY;
+
+        _index[i].offset = get64(entry);
+        _index[i].time = get64(entry + 8);
+        _index[i].count = get32(entry + 16);
+    }
+
+    /* Sprawdzenie tylko ostatniej paczki - pozostałe przy dekodowaniu */
+    if ((chunks) && (!_checkChunk(_index.last().offset, &_index.last()))) {
+        _index.clear();
+        return false;
+    }
+
+    return true;
+}
+
+/* Odbudowa indeksu przejściem po paczkach */
+void LogReader::_scanChunks() {
+    Chunk chunk;
+    qint64 offset = ECULOG_HEADER;
+
+    _index.clear();
+    while (_checkChunk(offset, &chunk)) {
+        _index.append(chunk);
+        offset += ECULOG_CHUNK_HEADER + get32(_data + offset + 24);
+    }
+}
+
+/* Paczka zawierająca czas (ostatnia zaczynająca się nie później), -1 - pusty log */
+int LogReader::findChunk(qint64 time) const {
+    int lo = 0, hi = _index.count();
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+
+        if (_index.at(mid).time <= time) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    return (lo > 0) ? lo - 1 : (_index.isEmpty() ? -1 : 0);
+}
+
+bool LogReader::readChunk(int chunk, QVector<LogSample> * samples) const {
+    const uchar * pos, * end;
+    Chunk check;
+    qint64 delta, prev;
+    quint32 count;
+
+    samples->clear();
+    if ((chunk < 0) || (chunk >= _index.count()) || (!_checkChunk(_index.at(chunk).offset, &check))) {
+        return false;
+    }
+
+    count = check.count;
+    pos = _data + check.offset + ECULOG_CHUNK_HEADER;
+    end = pos + get32(_data + check.offset + 24);
+    samples->resize(count);
+
+    prev = check.time;
+    for(quint32 i = 0; i < count; i++) {
+        if (!getDelta(&pos, end, &delta)) {
+            return false;
+        }
+        prev += delta;
+        (*samples)[i].time = prev;
+    }
+
+    for(int ch = 0; ch < LOG_CHANNELS; ch++) {
+        prev = 0;
+        for(quint32 i = 0; i < count; i++) {
+            if (!getDelta(&pos, end, &delta)) {
+                return false;
+            }
+            prev += delta;
+            (*samples)[i].values[ch] = prev;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Konwersja do tekstu: format logu tekstowego (jak zapisywała go wcześniej
+ * diag-app, czytany przy odtwarzaniu) albo CSV ze wszystkimi kanałami.
+ */
+bool LogReader::exportText(QIODevice * out, bool csv) const {
+    QVector<LogSample> samples;
+    QString line;
+
+    if (csv) {
+        out->write("time,rpm,advance,acceleration,throttle,temp,flags,cell\n");
+    }
+
+    for(int chunk = 0; chunk < chunks(); chunk++) {
+        if (!readChunk(chunk, &samples)) {
+            return false;
+        }
+
+        for(int i = 0; i < samples.count(); i++) {
+            const LogSample & s = samples.at(i);
+
+            if (csv) {
+                line = QString("%1").arg(s.time / 1e6, 0, 'f', 6);
+                for(int ch = 0; ch < LOG_CHANNELS; ch++) {
+                    line.append(QString(",%1").arg(s.values[ch]));
+                }
+            }
+            else {
+                line = _start.addMSecs(s.time / 1000).toLocalTime().toString("dd-MM-yyyy hh:mm:ss.zzz ");
+                line.append(QString::fromUtf8("%1 %2° %3 %4").arg(s.values[LOG_RPM]).arg(s.values[LOG_ADVANCE])
+                            .arg(s.values[LOG_ACCELERATION]).arg(s.values[LOG_THROTTLE]));
+                if (s.values[LOG_CELL] >= 0) {
+                    line.append(QString::fromUtf8(" %1°").arg(s.values[LOG_CELL]));
+                }
+            }
+
+            line.append('\n');
+            if (out->write(line.toUtf8()) < 0) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
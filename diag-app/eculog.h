@@ -0,0 +1,115 @@
+#ifndef ECULOG_H
+#define ECULOG_H
+
+#include <QFile>
+#include <QString>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QVector>
+#include <QIODevice>
+#include <stdint.h>
+
+/*
+ * Log binarny danych na żywo (*.etzlog). Próbki zapisywane są paczkami po
+ * ECULOG_CHUNK_SAMPLES, w paczce kolumnami (czas, potem kolejne kanały), każda
+ * wartość jako różnica względem poprzedniej w kolumnie (zigzag + varint, przy
+ * ramce co obrót zwykle 1-2 bajty na wartość). Paczki dekodują się niezależnie,
+ * a na końcu pliku jest indeks (przesunięcie i czas pierwszej próbki każdej
+ * paczki) - przewijanie to wyszukiwanie binarne w indeksie i dekodowanie
+ * jednej paczki. Plik bez indeksu (przerwany zapis) czytany jest paczka po
+ * paczce do pierwszej uszkodzonej.
+ *
+ * Układ (little endian):
+ * nagłówek  "ETZLOG01", wersja (16b), ilość kanałów (16b), 0 (32b), start [ms od 1970, UTC] (64b)
+ * paczka    "CHNK", ilość próbek (32b), czas pierwszej i ostatniej próbki [us] (2 x 64b),
+ *           rozmiar danych (32b), CRC16-CCITT danych (16b), 0 (16b), dane
+ * indeks    na paczkę: przesunięcie (64b), czas pierwszej próbki (64b), ilość próbek (32b), 0 (32b)
+ * koniec    przesunięcie indeksu (64b), ilość paczek (32b), "INDX"
+ */
+
+#define ECULOG_VERSION          1
+#define ECULOG_CHUNK_SAMPLES    1024
+
+/* Kanały logu */
+#define LOG_RPM                 0
+#define LOG_ADVANCE             1
+#define LOG_ACCELERATION        2
+#define LOG_THROTTLE            3
+#define LOG_TEMP                4
+#define LOG_FLAGS               5
+#define LOG_CELL                6 /* Wartość aktywnej komórki mapy [°], -1 - brak */
+#define LOG_CHANNELS            7
+
+struct LogSample {
+    qint64 time;                    /* Od początku logu [us] */
+    int32_t values[LOG_CHANNELS];
+};
+
+/* Zapis logu - próbki zbierane są w pamięci, do pliku trafiają całe paczki */
+class LogWriter {
+public:
+    LogWriter();
+    ~LogWriter();
+
+    bool open(const QString & fileName);
+    void close(void);
+    bool isOpen(void) const { return _file.isOpen(); }
+
+    qint64 elapsed(void) const { return _clock.nsecsElapsed() / 1000; }
+    bool append(const LogSample & sample);
+    bool flush(void);
+    bool sync(void);
+    qint64 bytes(void) const { return _file.isOpen() ? _file.pos() : 0; }
+    quint64 lost(void) const { return _lost; }
+
+private:
+    QFile _file;
+    QElapsedTimer _clock;
+    QVector<LogSample> _chunk;
+    QByteArray _index;
+    quint32 _chunks;
+    quint64 _lost;      /* Próbki z paczek, których nie udało się zapisać */
+};
+
+/* Odczyt logu - plik mapowany w pamięci, dekodowane są tylko potrzebne paczki */
+class LogReader {
+public:
+    LogReader();
+    ~LogReader();
+
+    bool open(const QString & fileName);
+    void close(void);
+    bool isOpen(void) const { return _data != NULL; }
+
+    QDateTime startTime(void) const { return _start; }
+    int chunks(void) const { return _index.count(); }
+    qint64 count(void) const { return _count; }
+    qint64 duration(void) const { return _duration; }
+
+    int findChunk(qint64 time) const;
+    bool readChunk(int chunk, QVector<LogSample> * samples) const;
+    bool exportText(QIODevice * out, bool csv) const;
+
+    static bool isBinaryLog(const QString & fileName);
+
+private:
+    struct Chunk {
+        qint64 offset;
+        qint64 time;
+        quint32 count;
+    };
+
+    QFile _file;
+    const uchar * _data;
+    qint64 _size;
+    QDateTime _start;
+    QVector<Chunk> _index;
+    qint64 _count;
+    qint64 _duration;
+
+    bool _loadIndex(void);
+    void _scanChunks(void);
+    bool _checkChunk(qint64 offset, Chunk * chunk) const;
+};
+
+#endif // ECULOG_H
@@ -0,0 +1,19 @@
+# Komunikacja z ECU wspólna dla diag-app i ecu-cli (bez GUI)
+
+QT       += core serialport
+
+CONFIG   += c++11
+
+INCLUDEPATH += $$PWD
+
+SOURCES += $$PWD/ecuframe.cpp \
+        $$PWD/eculink.cpp \
+        $$PWD/ecuprotocol.cpp \
+        $$PWD/eculog.cpp \
+        $$PWD/logthread.cpp
+
+HEADERS += $$PWD/ecuframe.h \
+        $$PWD/eculink.h \
+        $$PWD/ecuprotocol.h \
+        $$PWD/eculog.h \
+        $$PWD/logthread.h
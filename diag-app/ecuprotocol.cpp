@@ -0,0 +1,212 @@
+#include "ecuprotocol.h"
+
+/* Odpowiedź na 'd': obroty wyprzedzenie przyspieszenie przepustnica temperatura (dziesiętnie) */
+bool EcuProtocol::parseLiveData(const QByteArray & data, LiveData * live) {
+    QStringList values = QString(data.trimmed()).split(' ', QString::SkipEmptyParts);
+
+    if (values.count() < 5) {
+        return false;
+    }
+
+    live->seq = 0;
+    live->timestamp = 0;
+    live->rpm = values.at(0).toInt();
+    live->advance = values.at(1).toInt();
+    live->acceleration = values.at(2).toInt();
+    live->throttle = values.at(3).toInt();
+    live->temp = values.at(4).toInt();
+    live->flags = 0;
+    return true;
+}
+
+/* Odpowiedź na 'r': wiersze mapy rozdzielone ';', komórki dziesiętnie */
+bool EcuProtocol::parseMap(const QByteArray & data, QVector<int> * map) {
+    QStringList rows = QString(data).trimmed().split(';', QString::SkipEmptyParts);
+
+    if (rows.count() != MAP_ROWS) {
+        return false;
+    }
+
+    map->resize(MAP_ROWS * MAP_RPM_SIZE);
+    for(int i = 0; i < MAP_ROWS; i++) {
+        QStringList items = rows.at(i).trimmed().split(' ', QString::SkipEmptyParts);
+
+        if (items.count() != MAP_RPM_SIZE) {
+            return false;
+        }
+
+        for(int j = 0; j < MAP_RPM_SIZE; j++) {
+            (*map)[i * MAP_RPM_SIZE + j] = items.at(j).toInt();
+        }
+    }
+
+    return true;
+}
+
+/* Odpowiedź na 'x': oś obrotów; oś obciążenia (hex) */
+bool EcuProtocol::parseAxes(const QByteArray & data, QList<int> * rpmAxis, QList<int> * loadAxis) {
+    QStringList rows = QString(data).trimmed().split(';');
+
+    rpmAxis->clear();
+    loadAxis->clear();
+
+    if (rows.count() != 2) {
+        return false;
+    }
+
+    foreach (const QString & item, rows.at(0).trimmed().split(' ', QString::SkipEmptyParts)) {
+        rpmAxis->append(item.toInt(0, 16));
+    }
+
+    foreach (const QString & item, rows.at(1).trimmed().split(' ', QString::SkipEmptyParts)) {
+        loadAxis->append(item.toInt(0, 16));
+    }
+
+    return (rpmAxis->count() == MAP_RPM_SIZE) && (loadAxis->count() == MAP_LOAD_SIZE);
+}
+
+/* Odpowiedź na 'G': wszystkie parametry po 4 cyfry hex */
+bool EcuProtocol::parseParams(const QByteArray & data, QVector<uint16_t> * params) {
+    QStringList values = QString(data).trimmed().split(' ', QString::SkipEmptyParts);
+
+    if (values.count() != PARAM_COUNT) {
+        return false;
+    }
+
+    params->resize(PARAM_COUNT);
+    for(int i = 0; i < PARAM_COUNT; i++) {
+        (*params)[i] = values.at(i).toUInt(0, 16);
+    }
+
+    return true;
+}
+
+/* Odpowiedź na 'k': kody rozdzielone spacją (pusty kod - brak) */
+QStringList EcuProtocol::parseKeys(const QByteArray & data) {
+    return QString(data.trimmed()).split(' ');
+}
+
+QByteArray EcuProtocol::streamCommand(uint16_t period) {
+    return QString("l%1\r\n").arg(period, 4, 16, QLatin1Char('0')).toLocal8Bit();
+}
+
+/* Cała mapa ('w'), na końcu CRC - ECU zatwierdza mapę tylko, gdy zgadza się z odebraną */
+QByteArray EcuProtocol::writeMapCommand(const QVector<int> & map) {
+    QString command = "w";
+    uint16_t crc = 0xFFFF;
+
+    for(int i = 0; i < MAP_ROWS; i++) {
+        for(int j = 0; j < MAP_RPM_SIZE; j++) {
+            int value = map.at(i * MAP_RPM_SIZE + j);
+
+            command.append(QString("%1").arg(value, 2, 16, QLatin1Char('0')));
+            crc = EcuFrameDecoder::crc16(crc, value);
+        }
+
+        command.append(";");
+    }
+
+    command.append(QString("#%1\r\n").arg(crc, 4, 16, QLatin1Char('0')));
+    return command.toLocal8Bit();
+}
+
+QByteArray EcuProtocol::writeAxesCommand(const QList<int> & rpmAxis, const QList<int> & loadAxis) {
+    QString command = "y";
+
+    foreach (int value, rpmAxis + loadAxis) {
+        command.append(QString("%1").arg(value, 4, 16, QLatin1Char('0')));
+    }
+    command.append("\r\n");
+
+    return command.toLocal8Bit();
+}
+
+/* Jedna komórka ('c'), ECU zapisuje mapę do eeprom dopiero po chwili bez zmian */
+QByteArray EcuProtocol::writeCellCommand(int row, int col, int value) {
+    return QString("c%1%2%3\r\n").arg(row, 2, 16, QLatin1Char('0')).arg(col, 2, 16, QLatin1Char('0')).arg(value, 2, 16, QLatin1Char('0')).toLocal8Bit();
+}
+
+/* Parametry od first do końca params jednym poleceniem ('S'), ECU zapisuje eeprom raz */
+QByteArray EcuProtocol::writeParamsCommand(const QVector<uint16_t> & params, int first) {
+    QString command = QString("S%1").arg(first, 2, 16, QLatin1Char('0'));
+
+    for(int i = first; i < params.count(); i++) {
+        command.append(QString("%1").arg(params.at(i), 4, 16, QLatin1Char('0')));
+    }
+    command.append("\r\n");
+
+    return command.toLocal8Bit();
+}
+
+QByteArray EcuProtocol::writeKeysCommand(const QString & key0, const QString & key1) {
+    return QString("i%1 %2\r\n").arg(key0, IMMO_KEY_LEN, '0').arg(key1, IMMO_KEY_LEN, '0').toLocal8Bit();
+}
+
+/* Oś mapy z tekstu (size rosnących liczb 0 - max rozdzielonych spacjami), pusta lista gdy oś jest nieprawidłowa */
+QList<int> EcuProtocol::parseAxis(const QString & text, int size, int max) {
+    QList<int> axis;
+    bool ok;
+
+    foreach (const QString & item, text.split(' ', QString::SkipEmptyParts)) {
+        int value = item.toInt(&ok);
+
+        if ((!ok) || (value < 0) || (value > max) || ((!axis.isEmpty()) && (value <= axis.last()))) {
+            return QList<int>();
+        }
+
+        axis.append(value);
+    }
+
+    if (axis.count() != size) {
+        return QList<int>();
+    }
+
+    return axis;
+}
+
+/* Numer pierwszej komórki poza zakresem 0 - MAP_ADVANCE_MAX, -1 - mapa poprawna */
+int EcuProtocol::mapError(const QVector<int> & map) {
+    if (map.count() != MAP_ROWS * MAP_RPM_SIZE) {
+        return 0;
+    }
+
+    for(int i = 0; i < map.count(); i++) {
+        if ((map.at(i) < 0) || (map.at(i) > MAP_ADVANCE_MAX)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/* Próbka logu z danych na żywo (cell - wartość aktywnej komórki mapy, -1 - nieznana) */
+LogSample EcuProtocol::logSample(const LiveData & data, qint64 time, int cell) {
+    LogSample sample;
+
+    sample.time = time;
+    sample.values[LOG_RPM] = data.rpm;
+    sample.values[LOG_ADVANCE] = data.advance;
+    sample.values[LOG_ACCELERATION] = data.acceleration;
+    sample.values[LOG_THROTTLE] = data.throttle;
+    sample.values[LOG_TEMP] = data.temp;
+    sample.values[LOG_FLAGS] = data.flags;
+    sample.values[LOG_CELL] = cell;
+    return sample;
+}
+
+QString EcuProtocol::errorText(uint8_t exitCode) {
+    switch (exitCode) {
+    case 0x00:
+        return QString::fromUtf8("OK");
+    case ECU_ERR_ARGS:
+        return QString::fromUtf8("nieprawidłowe argumenty");
+    case ECU_ERR_RANGE:
+        return QString::fromUtf8("wartość poza zakresem");
+    case ECU_ERR_CRC:
+        return QString::fromUtf8("błąd CRC (dane uszkodzone w transmisji)");
+    case ECU_ERR_COMMAND:
+        return QString::fromUtf8("nieznane polecenie");
+    default:
+        return QString::fromUtf8("kod błędu = %1").arg(exitCode);
+    }
+}
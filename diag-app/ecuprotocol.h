@@ -0,0 +1,76 @@
+#ifndef ECUPROTOCOL_H
+#define ECUPROTOCOL_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QVector>
+#include <stdint.h>
+#include "ecuframe.h"
+#include "eculog.h"
+
+/* Parametry konfiguracji ECU (src/params.h) */
+#define PARAM_IGN_CUT_OFF_START  0
+#define PARAM_IGN_CUT_OFF_END    1
+#define PARAM_DYNAMIC_ON         2
+#define PARAM_DYNAMIC_OFF        3
+#define PARAM_CURRENT_MAP        4
+#define PARAM_IMMO_ENABLED       5
+#define PARAM_CRANK_OFFSET       6
+#define PARAM_DWELL_TIME         7
+#define PARAM_LIMIT_WINDOW       8
+#define PARAM_COUNT              9
+
+#define MAP_RPM_SIZE             16   /* Ilość punktów osi obrotów */
+#define MAP_LOAD_SIZE            4    /* Ilość punktów osi obciążenia */
+#define MAP_COUNT                4    /* Ilość map w ECU */
+#define MAP_ROWS                 (MAP_COUNT * MAP_LOAD_SIZE)
+#define MAP_LOAD_MAX             1023 /* Maksymalny odczyt przepustnicy */
+#define MAP_ADVANCE_MAX          90   /* Maksymalne wyprzedzenie w komórce mapy [°] */
+
+#define IMMO_KEYS                2
+#define IMMO_KEY_LEN             12
+
+/* Polecenia bez argumentów */
+#define ECU_CMD_VERSION          "v\r\n"
+#define ECU_CMD_LIVE_DATA        "d\r\n"
+#define ECU_CMD_READ_MAP         "r\r\n"
+#define ECU_CMD_READ_AXES        "x\r\n"
+#define ECU_CMD_READ_PARAMS      "G\r\n"
+#define ECU_CMD_READ_KEYS        "k\r\n"
+
+/* Kody błędów z promptu "xx>" */
+#define ECU_ERR_ARGS             0x01 /* Brak / zła ilość argumentów */
+#define ECU_ERR_RANGE            0x02 /* Wartość poza zakresem */
+#define ECU_ERR_CRC              0x03 /* CRC mapy się nie zgadza */
+#define ECU_ERR_COMMAND          0xFF /* Nieznane polecenie */
+
+/*
+ * Polecenia i odpowiedzi tekstowe ECU (src/interface.c) - budowanie poleceń z
+ * argumentami i dekodowanie odpowiedzi, bez kolejki i bez GUI. Wysyłaniem
+ * zajmuje się EcuLink, tu jest tylko format wspólny dla diag-app i ecu-cli.
+ * Mapa to MAP_ROWS wierszy po MAP_RPM_SIZE komórek, wiersz po wierszu.
+ */
+class EcuProtocol {
+public:
+    static bool parseLiveData(const QByteArray & data, LiveData * live);
+    static bool parseMap(const QByteArray & data, QVector<int> * map);
+    static bool parseAxes(const QByteArray & data, QList<int> * rpmAxis, QList<int> * loadAxis);
+    static bool parseParams(const QByteArray & data, QVector<uint16_t> * params);
+    static QStringList parseKeys(const QByteArray & data);
+
+    static QByteArray streamCommand(uint16_t period);
+    static QByteArray writeMapCommand(const QVector<int> & map);
+    static QByteArray writeAxesCommand(const QList<int> & rpmAxis, const QList<int> & loadAxis);
+    static QByteArray writeCellCommand(int row, int col, int value);
+    static QByteArray writeParamsCommand(const QVector<uint16_t> & params, int first = 0);
+    static QByteArray writeKeysCommand(const QString & key0, const QString & key1);
+
+    static QList<int> parseAxis(const QString & text, int size, int max);
+    static int mapError(const QVector<int> & map);
+    static LogSample logSample(const LiveData & data, qint64 time, int cell = -1);
+    static QString errorText(uint8_t exitCode);
+};
+
+#endif // ECUPROTOCOL_H
@@ -0,0 +1,122 @@
+#include "logthread.h"
+#include <QElapsedTimer>
+
+#define LOGTHREAD_MASK          ((1 << LOGTHREAD_QUEUE_SHIFT) - 1)
+
+LogThread::LogThread(QObject * parent) : QThread(parent) {
+    _head = 0;
+    _tail = 0;
+    _stop = false;
+    _written = 0;
+    _dropped = 0;
+    _failed = 0;
+    _bytes = 0;
+}
+
+LogThread::~LogThread() {
+    close();
+}
+
+/* Otwarcie pliku (w wątku GUI, błąd od razu widoczny) i start wątku zapisu */
+bool LogThread::open(const QString & fileName) {
+    close();
+
+    if (!_writer.open(fileName)) {
+        _writer.close();
+        return false;
+    }
+
+    _head = 0;
+    _tail = 0;
+    _stop = false;
+    _written = 0;
+    _dropped = 0;
+    _failed = 0;
+    _bytes = _writer.bytes();
+
+    start(QThread::LowPriority);
+    return true;
+}
+
+/* Zatrzymanie wątku po zapisaniu wszystkiego z kolejki, potem indeks i zamknięcie pliku */
+void LogThread::close() {
+    if (isRunning()) {
+        _mutex.lock();
+        _stop = true;
+        _wake.wakeAll();
+        _mutex.unlock();
+        wait();
+    }
+
+    _writer.close();
+    _failed = _writer.lost(); /* Także ostatnia paczka z close() */
+}
+
+/* Próbka do kolejki (tylko wątek GUI), false - kolejka pełna, próbka odrzucona */
+bool LogThread::push(const LogSample & sample) {
+    quint32 head = _head.load(std::memory_order_relaxed);
+
+    if (!isRunning()) {
+        return false;
+    }
+
+    if (head - _tail.load(std::memory_order_acquire) > LOGTHREAD_MASK) {
+        _dropped++;
+        return false;
+    }
+
+    _queue[head & LOGTHREAD_MASK] = sample;
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+LogThreadStats LogThread::stats() const {
+    LogThreadStats stats;
+
+    stats.written = _written;
+    stats.dropped = _dropped;
+    stats.failed = _failed;
+    stats.bytes = _bytes;
+    return stats;
+}
+
+/* Wszystkie próbki z kolejki do LogWriter (pełne paczki zapisywane są od razu, błąd zapisu liczony w _failed) */
+void LogThread::_drain() {
+    quint32 tail = _tail.load(std::memory_order_relaxed);
+    quint32 head = _head.load(std::memory_order_acquire);
+
+    while (tail != head) {
+        if (_writer.append(_queue[tail & LOGTHREAD_MASK])) {
+            _written++;
+        }
+        tail++;
+    }
+
+    _tail.store(tail, std::memory_order_release);
+    _bytes = _writer.bytes();
+    _failed = _writer.lost();
+}
+
+void LogThread::run() {
+    QElapsedTimer sync;
+
+    sync.start();
+    while (!_stop) {
+        _mutex.lock();
+        if (!_stop) {
+            _wake.wait(&_mutex, LOGTHREAD_BATCH);
+        }
+        _mutex.unlock();
+
+        _drain();
+
+        if (sync.elapsed() >= LOGTHREAD_SYNC) {
+            _writer.sync();
+            _bytes = _writer.bytes();
+            _failed = _writer.lost();
+            sync.restart();
+        }
+    }
+
+    _drain();
+}
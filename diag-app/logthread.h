@@ -0,0 +1,65 @@
+#ifndef LOGTHREAD_H
+#define LOGTHREAD_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QString>
+#include <atomic>
+#include "eculog.h"
+
+#define LOGTHREAD_QUEUE_SHIFT   12      /* Pojemność kolejki: 2^12 próbek (przy ramce co obrót kilkanaście sekund zapisu) */
+#define LOGTHREAD_BATCH         100     /* Okres opróżniania kolejki [ms] */
+#define LOGTHREAD_SYNC          1000    /* Okres zapisu niepełnej paczki i fsync [ms] */
+
+/* Statystyki zapisu (liczniki od otwarcia logu) */
+struct LogThreadStats {
+    quint64 written;    /* Próbki przekazane do pliku */
+    quint64 dropped;    /* Próbki odrzucone przy pełnej kolejce */
+    quint64 failed;     /* Próbki utracone przy błędzie zapisu pliku */
+    quint64 bytes;      /* Bajty zapisane do pliku */
+};
+
+/*
+ * Zapis logu w osobnym wątku. Wątek GUI wstawia próbki do kolejki o stałej
+ * pojemności (jeden zapisujący, jeden czytający, bez blokad - przy pełnej
+ * kolejce próbka jest odrzucana i liczona), wątek zapisu co LOGTHREAD_BATCH ms
+ * przenosi wszystko z kolejki do LogWriter, a co LOGTHREAD_SYNC ms zapisuje
+ * niepełną paczkę i wymusza zapis na nośnik. Wolny nośnik opóźnia tylko ten
+ * wątek, GUI i zapytania do ECU działają dalej.
+ */
+class LogThread : public QThread {
+    Q_OBJECT
+
+public:
+    LogThread(QObject * parent = 0);
+    ~LogThread();
+
+    bool open(const QString & fileName);
+    void close(void);
+    bool isOpen(void) const { return isRunning(); }
+
+    qint64 elapsed(void) const { return _writer.elapsed(); }
+    bool push(const LogSample & sample);
+    LogThreadStats stats(void) const;
+
+protected:
+    void run(void);
+
+private:
+    LogWriter _writer;
+    LogSample _queue[1 << LOGTHREAD_QUEUE_SHIFT];
+    std::atomic<quint32> _head;     /* Następne miejsce do zapisu (wątek GUI) */
+    std::atomic<quint32> _tail;     /* Następna próbka do odczytu (wątek zapisu) */
+    std::atomic<bool> _stop;
+    std::atomic<quint64> _written;
+    std::atomic<quint64> _dropped;
+    std::atomic<quint64> _failed;
+    std::atomic<quint64> _bytes;
+    QMutex _mutex;
+    QWaitCondition _wake;
+
+    void _drain(void);
+};
+
+#endif // LOGTHREAD_H
@@ -0,0 +1,115 @@
+#include "plotbuffer.h"
+
+PlotBuffer::PlotBuffer() {
+    _time.resize(1 << PLOT_BUFFER_SHIFT);
+    for(int ch = 0; ch < PLOT_CHANNELS; ch++) {
+        _values[ch].resize(1 << PLOT_BUFFER_SHIFT);
+    }
+
+    clear();
+}
+
+void PlotBuffer::clear() {
+    _start = 0;
+    _count = 0;
+}
+
+/* Nowa próbka, przy pełnym buforze zastępuje najstarszą */
+void PlotBuffer::append(double time, const float * values) {
+    int pos;
+
+    if (_count < (1 << PLOT_BUFFER_SHIFT)) {
+        pos = _index(_count);
+        _count++;
+    }
+    else {
+        pos = _start;
+        _start = _index(1);
+    }
+
+    _time[pos] = time;
+    for(int ch = 0; ch < PLOT_CHANNELS; ch++) {
+        _values[ch][pos] = values[ch];
+    }
+}
+
+double PlotBuffer::firstTime() const {
+    return _count ? _time.at(_start) : 0.0;
+}
+
+double PlotBuffer::lastTime() const {
+    return _count ? _time.at(_index(_count - 1)) : 0.0;
+}
+
+float PlotBuffer::lastValue(int channel) const {
+    return _count ? _values[channel].at(_index(_count - 1)) : 0.0f;
+}
+
+/* Numer (od najstarszej) pierwszej próbki nie starszej niż time */
+int PlotBuffer::_lowerBound(double time) const {
+    int lo = 0, hi = _count;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+
+        if (_time.at(_index(mid)) < time) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/*
+ * Min / max kanałów w kolumnach zakresu [t0, t1]. Wynik: columns * PLOT_CHANNELS
+ * elementów, kolumna po kolumnie (out[col * PLOT_CHANNELS + ch]).
+ */
+void PlotBuffer::decimate(double t0, double t1, int columns, QVector<PlotColumn> * out) const {
+    double scale;
+
+    out->resize(columns * PLOT_CHANNELS);
+    for(int i = 0; i < out->count(); i++) {
+        (*out)[i].valid = false;
+    }
+
+    if ((columns <= 0) || (t1 <= t0)) {
+        return;
+    }
+
+    scale = columns / (t1 - t0);
+
+    for(int i = _lowerBound(t0); i < _count; i++) {
+        int pos = _index(i);
+        int col;
+
+        if (_time.at(pos) > t1) {
+            break;
+        }
+
+        col = (int)((_time.at(pos) - t0) * scale);
+        if (col >= columns) {
+            col = columns - 1;
+        }
+
+        for(int ch = 0; ch < PLOT_CHANNELS; ch++) {
+            PlotColumn & c = (*out)[col * PLOT_CHANNELS + ch];
+            float value = _values[ch].at(pos);
+
+            if (!c.valid) {
+                c.valid = true;
+                c.min = c.max = c.first = value;
+            }
+            else if (value < c.min) {
+                c.min = value;
+            }
+            else if (value > c.max) {
+                c.max = value;
+            }
+
+            c.last = value;
+        }
+    }
+}
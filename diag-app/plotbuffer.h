@@ -0,0 +1,50 @@
+#ifndef PLOTBUFFER_H
+#define PLOTBUFFER_H
+
+#include <QVector>
+
+#define PLOT_CHANNELS           4       /* Ilość kanałów wykresu */
+#define PLOT_BUFFER_SHIFT       18      /* Pojemność bufora: 2^18 próbek (przy ramce co obrót kilkanaście minut jazdy) */
+
+/* Zakres wartości kanału w jednej kolumnie pikseli */
+struct PlotColumn {
+    bool valid;         /* false - brak próbek w kolumnie */
+    float min;
+    float max;
+    float first;        /* Pierwsza i ostatnia próbka - łączenie z sąsiednimi kolumnami */
+    float last;
+};
+
+/*
+ * Bufor cykliczny próbek wykresu o stałej pojemności (najstarsze próbki są
+ * nadpisywane, bez alokacji przy dopisywaniu). Próbki trzymane są kolumnami
+ * (czas, kanał 0, kanał 1, ...), czasy muszą rosnąć. Do rysowania zakres
+ * czasu dzielony jest na kolumny pikseli, a dla każdej liczone jest min / max
+ * kanału - jeden przebieg po próbkach z zakresu, niezależnie od ich ilości
+ * rysowane jest tyle odcinków, ile kolumn.
+ */
+class PlotBuffer {
+public:
+    PlotBuffer();
+
+    void append(double time, const float * values);
+    void clear(void);
+
+    int count(void) const { return _count; }
+    double firstTime(void) const;
+    double lastTime(void) const;
+    float lastValue(int channel) const;
+
+    void decimate(double t0, double t1, int columns, QVector<PlotColumn> * out) const;
+
+private:
+    QVector<double> _time;
+    QVector<float> _values[PLOT_CHANNELS];
+    int _start;         /* Indeks najstarszej próbki */
+    int _count;
+
+    int _index(int i) const { return (_start + i) & ((1 << PLOT_BUFFER_SHIFT) - 1); }
+    int _lowerBound(double time) const;
+};
+
+#endif // PLOTBUFFER_H
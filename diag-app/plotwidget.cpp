@@ -0,0 +1,116 @@
+#include "plotwidget.h"
+#include <QPainter>
+#include <QWheelEvent>
+#include <QLineF>
+#include <qmath.h>
+
+PlotWidget::PlotWidget(QWidget * parent) : QWidget(parent) {
+    for(int ch = 0; ch < PLOT_CHANNELS; ch++) {
+        setChannel(ch, QString::number(ch + 1), QColor(Qt::black), 0.0f, 1.0f);
+    }
+
+    _span = PLOT_SPAN_DEFAULT;
+    _dirty = false;
+
+    _refreshTimer = new QTimer(this);
+    _refreshTimer->setSingleShot(false);
+    _refreshTimer->setInterval(PLOT_REFRESH);
+    connect(_refreshTimer, SIGNAL(timeout()), this, SLOT(_refresh()));
+    _refreshTimer->start();
+
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    setMinimumHeight(PLOT_CHANNELS * 40);
+}
+
+void PlotWidget::setChannel(int channel, const QString & name, const QColor & color, float min, float max) {
+    if ((channel < 0) || (channel >= PLOT_CHANNELS) || (max <= min)) {
+        return;
+    }
+
+    _channels[channel].name = name;
+    _channels[channel].color = color;
+    _channels[channel].min = min;
+    _channels[channel].max = max;
+    _dirty = true;
+}
+
+/* Nowa próbka (values - PLOT_CHANNELS wartości), rysowana przy najbliższym odświeżeniu */
+void PlotWidget::append(double time, const float * values) {
+    _buffer.append(time, values);
+    _dirty = true;
+}
+
+void PlotWidget::clear() {
+    _buffer.clear();
+    _dirty = true;
+}
+
+void PlotWidget::setSpan(double seconds) {
+    _span = qBound(PLOT_SPAN_MIN, seconds, PLOT_SPAN_MAX);
+    _dirty = true;
+}
+
+void PlotWidget::_refresh() {
+    if (_dirty) {
+        _dirty = false;
+        update();
+    }
+}
+
+/* Kółko myszy - szerokość okna (krok 25%) */
+void PlotWidget::wheelEvent(QWheelEvent * event) {
+    setSpan(_span * qPow(1.25, -event->delta() / 120.0));
+    event->accept();
+}
+
+void PlotWidget::paintEvent(QPaintEvent * event) {
+    QPainter painter(this);
+    QVector<QLineF> lines;
+    int columns = width();
+    int laneHeight = height() / PLOT_CHANNELS;
+    double t1 = _buffer.lastTime();
+
+    Q_UNUSED(event);
+
+    painter.fillRect(rect(), QColor(Qt::white));
+    _buffer.decimate(t1 - _span, t1, columns, &_columns);
+
+    for(int ch = 0; ch < PLOT_CHANNELS; ch++) {
+        const Channel & channel = _channels[ch];
+        int top = ch * laneHeight;
+        float scale = (laneHeight - 1) / (channel.max - channel.min);
+        int prev = -1;
+
+        /* Wartość -> y w pasie kanału (poza zakresem - na krawędzi pasa) */
+        auto y = [&](float value) {
+            return top + laneHeight - 1 - (qBound(channel.min, value, channel.max) - channel.min) * scale;
+        };
+
+        lines.clear();
+        for(int col = 0; col < columns; col++) {
+            const PlotColumn & c = _columns.at(col * PLOT_CHANNELS + ch);
+
+            if (!c.valid) {
+                continue;
+            }
+
+            if (prev >= 0) {
+                lines.append(QLineF(prev, y(_columns.at(prev * PLOT_CHANNELS + ch).last), col, y(c.first)));
+            }
+            lines.append(QLineF(col, y(c.min), col, y(c.max)));
+            prev = col;
+        }
+
+        painter.setPen(QColor(Qt::lightGray));
+        painter.drawLine(0, top + laneHeight - 1, columns, top + laneHeight - 1);
+
+        painter.setPen(channel.color);
+        painter.drawLines(lines);
+
+        painter.drawText(4, top + painter.fontMetrics().ascent() + 2,
+                         QString("%1: %2").arg(channel.name).arg(_buffer.lastValue(ch)));
+    }
+
+    painter.setPen(QColor(Qt::darkGray));
+    painter.drawText(rect().adjusted(0, 0, -4, -2), Qt::AlignRight | Qt::AlignBottom, QString::fromUtf8("%1 s").arg(_span, 0, 'f', 1));
+}
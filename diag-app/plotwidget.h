@@ -0,0 +1,59 @@
+#ifndef PLOTWIDGET_H
+#define PLOTWIDGET_H
+
+#include <QWidget>
+#include <QColor>
+#include <QString>
+#include <QTimer>
+#include "plotbuffer.h"
+
+#define PLOT_REFRESH            40      /* Okres odświeżania wykresu [ms] */
+#define PLOT_SPAN_DEFAULT       10.0    /* Domyślna szerokość okna [s] */
+#define PLOT_SPAN_MIN           0.5
+#define PLOT_SPAN_MAX           600.0
+
+/*
+ * Przewijany wykres kilku kanałów (każdy w osobnym pasie, ze stałym
+ * zakresem). Próbki trafiają do PlotBuffer, rysowanie odbywa się najwyżej co
+ * PLOT_REFRESH ms i tylko gdy przyszły nowe dane - każda kolumna pikseli to
+ * jeden odcinek min / max, więc czas rysowania nie zależy od ilości próbek.
+ * Kółko myszy zmienia szerokość okna, prawe okno zawsze kończy się na
+ * ostatniej próbce.
+ */
+class PlotWidget : public QWidget {
+    Q_OBJECT
+
+public:
+    explicit PlotWidget(QWidget * parent = 0);
+
+    void setChannel(int channel, const QString & name, const QColor & color, float min, float max);
+    void append(double time, const float * values);
+    void clear(void);
+
+    double span(void) const { return _span; }
+    void setSpan(double seconds);
+
+protected:
+    void paintEvent(QPaintEvent * event);
+    void wheelEvent(QWheelEvent * event);
+
+private slots:
+    void _refresh(void);
+
+private:
+    struct Channel {
+        QString name;
+        QColor color;
+        float min;
+        float max;
+    };
+
+    PlotBuffer _buffer;
+    Channel _channels[PLOT_CHANNELS];
+    QVector<PlotColumn> _columns;
+    QTimer * _refreshTimer;
+    double _span;
+    bool _dirty;
+};
+
+#endif // PLOTWIDGET_H
@@ -5,11 +5,17 @@
 #include <QFileDialog>
 #include <QFileInfo>
 #include <QDateTime>
+#include <string.h>
 
 WndMain::WndMain(QWidget *parent) : QMainWindow(parent), _ui(new Ui::WndMain) {
     _ui->setupUi(this);
 
-    _serial = new QSerialPort();
+    _link = new EcuLink();
+    _logThread = new LogThread();
+    memset(&_logStats, 0, sizeof(_logStats));
+    _livePending = false;
+    connect(_link, SIGNAL(frameReceived(EcuFrame)), this, SLOT(_frameReceived(EcuFrame)));
+    connect(_link, SIGNAL(portError()), this, SLOT(_ecuDisconnected()));
 
     _liveDataTimer = new QTimer();
     _liveDataTimer->setSingleShot(false);
@@ -21,27 +27,93 @@ WndMain::WndMain(QWidget *parent) : QMainWindow(parent), _ui(new Ui::WndMain) {
     _connectTimer->setInterval(1000);
     connect(_connectTimer, SIGNAL(timeout()), this, SLOT(_scanPorts()));
 
+    /* W trybie transmisji co obrót ECU wysyła ramkę najpóźniej co 250ms */
+    _streamWatchdog = new QTimer();
+    _streamWatchdog->setSingleShot(true);
+    _streamWatchdog->setInterval(1000);
+    connect(_streamWatchdog, SIGNAL(timeout()), this, SLOT(_ecuDisconnected()));
+
+    /* Statystyki opóźnień poleceń w pasku stanu */
+    _lLinkStats = new QLabel();
+    _ui->statusBar->addPermanentWidget(_lLinkStats);
+    _lLogStats = new QLabel();
+    _ui->statusBar->addPermanentWidget(_lLogStats);
+    _statsTimer = new QTimer();
+    _statsTimer->setSingleShot(false);
+    _statsTimer->setInterval(1000);
+    connect(_statsTimer, SIGNAL(timeout()), this, SLOT(_updateLinkStats()));
+    _statsTimer->start();
+
+    connect(_ui->cbStream, SIGNAL(toggled(bool)), this, SLOT(_setStreaming(bool)));
+
     connect(_ui->pbReadEcuMap, SIGNAL(clicked()), this, SLOT(_readEcuMap()));
     connect(_ui->pbWriteEcuMap, SIGNAL(clicked()), this, SLOT(_writeEcuMap()));
 
     connect(_ui->pbReadParams, SIGNAL(clicked()), this, SLOT(_readParams()));
     connect(_ui->pbWriteParams, SIGNAL(clicked()), this, SLOT(_writeParams()));
     _ecuDisconnected();
+    _updateLinkStats();
 
-    _logFile = NULL;
     _ui->lLogFileName->setText(QString::fromUtf8("Plik log: (brak)"));
 
     connect(_ui->pbSelectFile, SIGNAL(clicked()), this, SLOT(_setLogFile()));
+
+    /* Domyślne osie mapy (takie same jak w ECU przy pustym eeprom) */
+    QList<int> rpmAxis, loadAxis;
+    for(int i = 0; i < MAP_RPM_SIZE; i++) {
+        rpmAxis.append(250 + i * 500);
+    }
+    for(int i = 0; i < MAP_LOAD_SIZE; i++) {
+        loadAxis.append((i * MAP_LOAD_MAX) / (MAP_LOAD_SIZE - 1));
+    }
+
+    _ui->twIgnitionMap->setRowCount(MAP_COUNT * MAP_LOAD_SIZE);
+    _ui->twIgnitionMap->setColumnCount(MAP_RPM_SIZE);
+    for(int row = 0; row < _ui->twIgnitionMap->rowCount(); row++) {
+        for(int col = 0; col < _ui->twIgnitionMap->columnCount(); col++) {
+            _ui->twIgnitionMap->setItem(row, col, new QTableWidgetItem());
+        }
+    }
+    _activeRow = -1;
+    _activeCol = -1;
+    _setMapAxes(rpmAxis, loadAxis);
+    _ecuMap.fill(-1, MAP_COUNT * MAP_LOAD_SIZE * MAP_RPM_SIZE);
+    connect(_ui->twIgnitionMap, SIGNAL(itemChanged(QTableWidgetItem*)), this, SLOT(_mapCellEdited(QTableWidgetItem*)));
+
+    connect(_ui->leRpmAxis, SIGNAL(editingFinished()), this, SLOT(_mapAxesEdited()));
+    connect(_ui->leLoadAxis, SIGNAL(editingFinished()), this, SLOT(_mapAxesEdited()));
+
+    /* Wykres - dane na żywo albo odtwarzany log */
+    _ui->wPlot->setChannel(PLOT_RPM, "RPM", QColor(Qt::red), 0, 9000);
+    _ui->wPlot->setChannel(PLOT_ADVANCE, QString::fromUtf8("Wyprzedzenie [°]"), QColor(Qt::blue), 0, MAP_ADVANCE_MAX / 2);
+    _ui->wPlot->setChannel(PLOT_ACCELERATION, QString::fromUtf8("Przyspieszenie"), QColor(Qt::darkGreen), -500, 500);
+    _ui->wPlot->setChannel(PLOT_THROTTLE, QString::fromUtf8("Przepustnica"), QColor(Qt::darkMagenta), 0, MAP_LOAD_MAX);
+    _plotClock.start();
+
+    _replayTimer = new QTimer();
+    _replayTimer->setSingleShot(false);
+    _replayTimer->setInterval(PLOT_REFRESH);
+    connect(_replayTimer, SIGNAL(timeout()), this, SLOT(_replayStep()));
+    _replayPos = 0;
+    _replayChunk = 0;
+    _replayOffset = 0;
+    _replayShown = false;
+    _ui->hsReplay->setEnabled(false);
+
+    connect(_ui->pbReplayLog, SIGNAL(clicked()), this, SLOT(_replayLog()));
+    connect(_ui->pbClearPlot, SIGNAL(clicked()), this, SLOT(_clearPlot()));
+    connect(_ui->hsReplay, SIGNAL(valueChanged(int)), this, SLOT(_replaySeek(int)));
+    connect(_ui->pbConvertLog, SIGNAL(clicked()), this, SLOT(_convertLog()));
 }
 
 WndMain::~WndMain() {
+    delete _replayTimer;
+    delete _statsTimer;
+    delete _streamWatchdog;
     delete _connectTimer;
-    delete _serial;
+    delete _link;
+    delete _logThread;
     delete _ui;
-
-    if (_logFile) {
-        delete _logFile;
-    }
 }
 
 void WndMain::changeEvent(QEvent *e) {
@@ -56,36 +128,43 @@ void WndMain::changeEvent(QEvent *e) {
 }
 
 bool WndMain::_ecuConnect(const QSerialPortInfo &port) {
-    QByteArray version;
+    QString portName = port.portName();
 
-    _serial->setPort(port);
-    _serial->setBaudRate(9600);
-    if (!_serial->open(QIODevice::ReadWrite)) {
+    if (!_link->open(port)) {
         return false;
     }
 
-    _ui->statusBar->showMessage(QString::fromUtf8("Port %1 otwarty...").arg(port.portName()));
-
+    _link->resetStats();
+    _ui->statusBar->showMessage(QString::fromUtf8("Port %1 otwarty...").arg(portName));
 
-    /* Próbujemy odczytać wersje softu */
-    if (!_ecuCommand(QByteArray("v\r\n"), NULL, &version))
-        return false;
+    /* Próbujemy odczytać wersje softu, reszta po odpowiedzi */
+    _link->command(ECU_CMD_VERSION, [this, portName](const EcuReply & reply) {
+        if (!reply.ok) {
+            _ecuDisconnected();
+            return;
+        }
 
-    _ui->statusBar->showMessage(QString::fromUtf8("Podłączono do: %1 (port: %2)").arg(QString(version.trimmed())).arg(port.portName()));
+        _ui->statusBar->showMessage(QString::fromUtf8("Podłączono do: %1 (port: %2)").arg(QString(reply.data.trimmed())).arg(portName));
 
-    _readEcuMap();
-    _readParams();
+        _readEcuMap();
+        _readParams();
 
-    _liveDataTimer->start();
+        _liveDataTimer->start();
+    });
 
     return true;
 }
 
 void WndMain::_ecuDisconnected() {
-    if (_serial->isOpen())
-        _serial->close();
+    _link->close();
+    _livePending = false;
 
     _liveDataTimer->stop();
+    _streamWatchdog->stop();
+
+    _ui->cbStream->blockSignals(true);
+    _ui->cbStream->setChecked(false);
+    _ui->cbStream->blockSignals(false);
 
     _ui->lCrankAccel->setText("-");
     _ui->lEngineTemp->setText(QString::fromUtf8("- °C"));
@@ -110,297 +189,659 @@ void WndMain::_scanPorts() {
 }
 
 void WndMain::_updateLiveData() {
-    QByteArray data;
-    QStringList values;
-    QString logLine;
-    int rpm;
-
-    if (!_ecuCommand("d\r\n", NULL, &data)) {
-        _ecuDisconnected();
+    /* Poprzednie zapytanie jeszcze bez odpowiedzi, nie dokładamy kolejnych do kolejki */
+    if (_livePending) {
         return;
     }
-    values = QString(data.trimmed()).split(' ');
-    if (values.size() < 4) {
-        _ecuDisconnected();
-        return;
+
+    _livePending = true;
+
+    /* Bez powtórzeń - kolejne zapytanie i tak pójdzie za 50ms */
+    _link->command(ECU_CMD_LIVE_DATA, [this](const EcuReply & reply) {
+        LiveData live;
+
+        _livePending = false;
+
+        if ((!reply.ok) || (!EcuProtocol::parseLiveData(reply.data, &live))) {
+            _ecuDisconnected();
+            return;
+        }
+
+        _showLiveData(live);
+    }, ECULINK_TIMEOUT, 0);
+}
+
+/* Tło komórki mapy (poza mapą - nic), zmiana odświeża tylko tę komórkę */
+void WndMain::_setCellColor(int row, int col, const QColor & color) {
+    QTableWidgetItem * item = _ui->twIgnitionMap->item(row, col);
+
+    if ((item) && (item->backgroundColor() != color)) {
+        item->setBackgroundColor(color);
     }
+}
 
+void WndMain::_showLiveData(const LiveData &data) {
+    QTableWidgetItem * item;
+    LogSample sample;
+    int activeRow, activeCol;
 
-    logLine.append(QDateTime::currentDateTime().toString("dd-MM-yyyy hh:mm:ss.zzz "));
+    _ui->lRPM->setText(QString("%1 RPM").arg(data.rpm));
+    _ui->lIgnitionAdvance->setText(QString::fromUtf8("%1 °").arg(data.advance));
+    _ui->lCrankAccel->setText(QString::number(data.acceleration));
+    _ui->lEngineTemp->setText(QString::fromUtf8("%1 °C").arg(data.temp));
 
-    rpm = values[0].toInt();
-    _ui->lRPM->setText(QString("%1 RPM").arg(rpm));
-    _ui->lIgnitionAdvance->setText(QString::fromUtf8("%1 °").arg(values[1]));
-    _ui->lCrankAccel->setText(values[2]);
 
-    logLine.append(QString::fromUtf8("%1 %2° %3").arg(rpm).arg(values[1]).arg(values[2]));
+    /* Fancy podświetlanie aktywnego fragmentu mapy zapłonu (komórka, od której zaczyna się interpolacja) */
+    activeCol = _axisBin(_rpmAxis, data.rpm);
+    activeRow = _ui->cbCurrentMap->currentIndex() * MAP_LOAD_SIZE + _axisBin(_loadAxis, data.throttle);
 
-    /* Fancy podświetlanie aktywnego fragmentu mapy zapłonu */
-    for(int col = 0; col < _ui->twIgnitionMap->columnCount(); col++) {
-        QColor color;
+    /* Ramki przychodzą co obrót - przemalowanie całej tabeli za każdym razem nie nadąża, zmieniamy tylko poprzednią i nową komórkę */
+    if ((activeRow != _activeRow) || (activeCol != _activeCol)) {
+        _setCellColor(_activeRow, _activeCol, QColor(Qt::white));
+        _setCellColor(activeRow, activeCol, QColor(Qt::green));
+        _activeRow = activeRow;
+        _activeCol = activeCol;
+    }
 
-        for(int row = 0; row < _ui->twIgnitionMap->rowCount(); row++) {
-            if (((rpm / 500) == col) && (row == _ui->cbCurrentMap->currentIndex())) {
-                color = QColor(Qt::green);
-                logLine.append(QString::fromUtf8(" %1°").arg(_ui->twIgnitionMap->item(row, col)->text()));
-            }
-            else {
-                color = QColor(Qt::white);
-            }
+    item = _ui->twIgnitionMap->item(activeRow, activeCol);
 
+    sample = EcuProtocol::logSample(data, _plotClock.nsecsElapsed() / 1000, ((item) && (!item->text().isEmpty())) ? item->text().toInt() : -1);
 
-            if (!_ui->twIgnitionMap->item(row, col)) {
-                _ui->twIgnitionMap->setItem(row, col, new QTableWidgetItem());
-            }
-            _ui->twIgnitionMap->item(row, col)->setBackgroundColor(color);
-        }
+    /* Wykres pokazuje odtwarzany log aż do wyczyszczenia */
+    if (!_replayShown) {
+        _plotSample(sample);
     }
 
-    logLine.append('\n');
-    if ((_ui->cbLogEnabled->isChecked()) && (_logFile) && (_logFile->isOpen())) {
-        _logFile->write(logLine.toUtf8());
+    /* Zapis w wątku logu, tu tylko wstawienie do kolejki */
+    if ((_ui->cbLogEnabled->isChecked()) && (_logThread->isOpen())) {
+        sample.time = _logThread->elapsed();
+        _logThread->push(sample);
     }
 }
 
-void WndMain::_readEcuMap() {
-    QByteArray data;
-    QStringList rows;
-    QStringList items;
-
-    if (!_ecuCommand("r\r\n", NULL, &data)) {
+void WndMain::_setStreaming(bool enabled) {
+    if (!_link->isOpen()) {
         return;
     }
 
-    rows = QString(data).trimmed().split(';');
-    if (_ui->twIgnitionMap->rowCount() != (rows.count() - 1)) {
-        qDebug() << "Wrong rowCount" << _ui->twIgnitionMap->rowCount() << "!=" << (rows.count() - 1);
+    _link->command(EcuProtocol::streamCommand(enabled ? STREAM_EVERY_REVOLUTION : STREAM_OFF), [this, enabled](const EcuReply & reply) {
+        if ((!reply.ok) || (reply.exitCode)) {
+            _showError("Transmisja danych", QString::fromUtf8("Błąd przełączania transmisji danych w ECU"));
+            _ui->cbStream->blockSignals(true);
+            _ui->cbStream->setChecked(!enabled);
+            _ui->cbStream->blockSignals(false);
+            return;
+        }
+
+        if (enabled) {
+            /* Dane przychodzą same, odpytywanie niepotrzebne */
+            _liveDataTimer->stop();
+            _streamWatchdog->start();
+        }
+        else {
+            _streamWatchdog->stop();
+            _liveDataTimer->start();
+        }
+    });
+}
+
+void WndMain::_frameReceived(const EcuFrame & frame) {
+    LiveData live;
+
+    if (LiveData::fromFrame(frame, &live)) {
+        _showLiveData(live);
+        if (_ui->cbStream->isChecked()) {
+            _streamWatchdog->start();
+        }
+    }
+}
+
+void WndMain::_updateLinkStats() {
+    const EcuLinkStats & stats = _link->stats();
+    LogThreadStats log = _logThread->stats();
+
+    /* Zapis logu: próbki i bajty od poprzedniego odświeżenia (co 1s) */
+    if (_logThread->isOpen()) {
+        _lLogStats->setText(QString::fromUtf8("Log: %1 próbek/s, %2 kB/s | odrzucone: %3, błędy zapisu: %4")
+                            .arg(log.written - _logStats.written)
+                            .arg((log.bytes - _logStats.bytes) / 1024.0, 0, 'f', 1)
+                            .arg(log.dropped)
+                            .arg(log.failed));
+    }
+    else {
+        _lLogStats->setText(QString::fromUtf8("Log: -"));
+    }
+    _logStats = log;
+
+    if (!stats.replies) {
+        _lLinkStats->setText(QString::fromUtf8("Odpowiedź: - | kolejka: %1").arg(_link->pending()));
         return;
     }
-    for(int i = 0; i < rows.count() - 1; i++) {
-        items = rows.at(i).trimmed().split(' ');
 
-        for(int j = 0; j < items.count(); j++) {
-            if (!_ui->twIgnitionMap->item(i, j)) {
-                _ui->twIgnitionMap->setItem(i, j, new QTableWidgetItem(items.at(j)));
-            }
-            else {
-                _ui->twIgnitionMap->item(i, j)->setText(items.at(j));
+    _lLinkStats->setText(QString::fromUtf8("Odpowiedź: śr. %1 ms (min %2, max %3) | kolejka: %4 | timeout: %5 (powt. %6, błędy %7) | CRC: %8")
+                         .arg(stats.totalLatency / (double)stats.replies / 1000.0, 0, 'f', 1)
+                         .arg(stats.minLatency / 1000.0, 0, 'f', 1)
+                         .arg(stats.maxLatency / 1000.0, 0, 'f', 1)
+                         .arg(_link->pending())
+                         .arg(stats.timeouts)
+                         .arg(stats.retries)
+                         .arg(stats.failures)
+                         .arg(_link->crcErrors()));
+}
+
+void WndMain::_readEcuMap() {
+    _link->command(ECU_CMD_READ_MAP, [this](const EcuReply & reply) {
+        QVector<int> map;
+
+        if (!reply.ok) {
+            return;
+        }
+
+        /* Przepustowość odczytu mapy (porównywanie wersji firmware) */
+        qDebug() << "Odczyt mapy:" << reply.data.size() << "B w" << reply.latency << "us," << (reply.data.size() * 1000000LL / qMax(reply.latency, (qint64)1)) << "B/s";
+
+        if (!EcuProtocol::parseMap(reply.data, &map)) {
+            qDebug() << "Wrong map" << reply.data;
+            return;
+        }
+
+        /* Przed setText - itemChanged nie wyśle wartości z powrotem */
+        _ecuMap = map;
+        for(int i = 0; i < MAP_ROWS; i++) {
+            for(int j = 0; j < MAP_RPM_SIZE; j++) {
+                _ui->twIgnitionMap->item(i, j)->setText(QString::number(map.at(i * MAP_RPM_SIZE + j)));
             }
         }
-    }
+    });
+
+    /* Osie mapy */
+    _link->command(ECU_CMD_READ_AXES, [this](const EcuReply & reply) {
+        QList<int> rpmAxis, loadAxis;
+
+        if (!reply.ok) {
+            return;
+        }
+
+        if (!EcuProtocol::parseAxes(reply.data, &rpmAxis, &loadAxis)) {
+            qDebug() << "Wrong axes" << reply.data;
+            return;
+        }
+
+        _setMapAxes(rpmAxis, loadAxis);
+    });
 }
 
 void WndMain::_writeEcuMap() {
-    uint8_t exitCode;
-    QString command = "w";
+    QList<int> rpmAxis, loadAxis;
+    QByteArray mapCommand;
+    QVector<int> values;
+    int error;
+
+    rpmAxis = EcuProtocol::parseAxis(_ui->leRpmAxis->text(), MAP_RPM_SIZE, 0xFFFF);
+    loadAxis = EcuProtocol::parseAxis(_ui->leLoadAxis->text(), MAP_LOAD_SIZE, MAP_LOAD_MAX);
+    if ((rpmAxis.isEmpty()) || (loadAxis.isEmpty())) {
+        QMessageBox::critical(this, "Zapis mapy do ECU", QString::fromUtf8("Nieprawidłowe osie mapy (oczekiwano %1 i %2 rosnących wartości)").arg(MAP_RPM_SIZE).arg(MAP_LOAD_SIZE));
+        return;
+    }
+    _setMapAxes(rpmAxis, loadAxis);
 
     for(int i = 0; i < _ui->twIgnitionMap->rowCount(); i++) {
         for(int j = 0; j < _ui->twIgnitionMap->columnCount(); j++) {
-            command.append(QString("%1").arg(_ui->twIgnitionMap->item(i, j)->text().toInt(), 2, 16, QLatin1Char('0')));
+            values.append(_ui->twIgnitionMap->item(i, j)->text().toInt());
         }
+    }
 
-        command.append(";");
+    if ((error = EcuProtocol::mapError(values)) >= 0) {
+        QMessageBox::critical(this, "Zapis mapy do ECU", QString::fromUtf8("Nieprawidłowe wyprzedzenie w komórce (%1, %2), dozwolone 0 - %3°").arg(error / MAP_RPM_SIZE + 1).arg(error % MAP_RPM_SIZE + 1).arg(MAP_ADVANCE_MAX));
+        return;
     }
 
-    command.append("\r\n");
+    /* CRC mapy w poleceniu - ECU zatwierdza mapę tylko, gdy zgadza się z odebraną */
+    mapCommand = EcuProtocol::writeMapCommand(values);
+
+    /* Mapa wysyłana dopiero po poprawnym zapisie osi */
+    _link->command(EcuProtocol::writeAxesCommand(rpmAxis, loadAxis), [this, mapCommand, values](const EcuReply & reply) {
+        if ((!reply.ok) || (reply.exitCode != 0)) {
+            _showError("Zapis mapy do ECU", QString::fromUtf8("Błąd zapisu osi mapy do ECU"));
+            return;
+        }
+
+        /* Bez powtórzeń - ponowne wysłanie całej mapy nic nie da, jeżeli ECU nie odpowiada */
+        _link->command(mapCommand, [this, mapCommand, values](const EcuReply & reply) {
+            if (!reply.ok) {
+                _showError("Zapis mapy do ECU", QString::fromUtf8("Błąd zapisu danych do ECU (timeout podczas wykonywania polecenia)"));
+                return;
+            }
+
+            /* Czas zapisu mapy (odbiór w ECU, eeprom zapisywany jest później w tle) */
+            qDebug() << "Zapis mapy:" << mapCommand.size() << "B w" << reply.latency << "us," << (mapCommand.size() * 1000000LL / qMax(reply.latency, (qint64)1)) << "B/s";
 
-    //qDebug() << command;
+            if (reply.exitCode == ECU_ERR_RANGE) {
+                _showError("Zapis mapy do ECU", QString::fromUtf8("ECU odrzuciło mapę - wyprzedzenie poza zakresem"));
+            }
+            else if (reply.exitCode == ECU_ERR_CRC) {
+                _showError("Zapis mapy do ECU", QString::fromUtf8("ECU odrzuciło mapę - błąd CRC (dane uszkodzone w transmisji)"));
+            }
+            else if (reply.exitCode != 0) {
+                _showError("Zapis mapy do ECU", QString::fromUtf8("Błąd zapisu danych do ECU (kod błędu = %1)").arg(reply.exitCode));
+            }
+            else {
+                _ecuMap = values;
+            }
+        }, ECULINK_TIMEOUT, 0);
+    });
+}
 
-    if (!_ecuCommand(command.toLocal8Bit(), &exitCode, NULL)) {
-        QMessageBox::critical(this, "Zapis mapy do ECU", QString::fromUtf8("Błąd zapisu danych do ECU (timeout podczas wykonywania polecenia)"));
+/*
+ * Edycja na żywo - zmieniona komórka wysyłana jest od razu poleceniem 'c'
+ * (tylko ta komórka, ECU zapisuje mapę do eeprom dopiero po chwili bez zmian).
+ * itemChanged przychodzi też przy zmianie tła (podświetlenie aktualnej
+ * komórki) i po odczycie mapy, wtedy tekst jest równy wartości w ECU.
+ */
+void WndMain::_mapCellEdited(QTableWidgetItem * item) {
+    int row = item->row(), col = item->column();
+    int index = row * MAP_RPM_SIZE + col;
+    bool ok;
+    int value;
+
+    if ((!_ui->cbLiveEdit->isChecked()) || (!_link->isOpen()) || (index < 0) || (index >= _ecuMap.count()) || (_ecuMap.at(index) < 0)) {
         return;
     }
 
-    if (exitCode != 0) {
-        QMessageBox::critical(this, "Zapis mapy do ECU", QString::fromUtf8("Błąd zapisu danych do ECU (kod błędu = %1)").arg(exitCode));
+    value = item->text().toInt(&ok);
+    if ((ok) && (value == _ecuMap.at(index))) {
+        return;
     }
-}
 
-void WndMain::_readParams() {
-    uint16_t data;
+    if ((!ok) || (value < 0) || (value > MAP_ADVANCE_MAX)) {
+        item->setText(QString::number(_ecuMap.at(index)));
+        _showError("Edycja mapy", QString::fromUtf8("Nieprawidłowe wyprzedzenie w komórce (%1, %2), dozwolone 0 - %3°").arg(row + 1).arg(col + 1).arg(MAP_ADVANCE_MAX));
+        return;
+    }
 
-    data = _readEcuParam(PARAM_IGN_CUT_OFF_START);
-    if (data != 0xFFFF)
-        _ui->sbCuttOffStart->setValue(data);
+    _link->command(EcuProtocol::writeCellCommand(row, col, value), [this, row, col, index, value](const EcuReply & reply) {
+        QTableWidgetItem * item = _ui->twIgnitionMap->item(row, col);
 
-    data = _readEcuParam(PARAM_IGN_CUT_OFF_END);
-    if (data != 0xFFFF)
-        _ui->sbCuttOffEnd->setValue(data);
+        if ((reply.ok) && (reply.exitCode == 0)) {
+            _ecuMap[index] = value;
+            return;
+        }
+
+        /* Przywrócenie wartości z ECU, o ile w międzyczasie komórka nie została zmieniona ponownie */
+        if ((item) && (item->text().toInt() == value)) {
+            item->setText(QString::number(_ecuMap.at(index)));
+        }
+
+        if (!reply.ok) {
+            _showError("Edycja mapy", QString::fromUtf8("Błąd zapisu komórki do ECU (timeout)"));
+        }
+        else {
+            _showError("Edycja mapy", QString::fromUtf8("ECU odrzuciło komórkę (%1, %2) (kod błędu = %3)").arg(row + 1).arg(col + 1).arg(reply.exitCode));
+        }
+    });
+}
 
-    data = _readEcuParam(PARAM_DYNAMIC_ON);
-    if (data != 0xFFFF)
-        _ui->sbDynamicOn->setValue(data);
+void WndMain::_readParams() {
+    /* Wszystkie parametry jednym poleceniem */
+    _link->command(ECU_CMD_READ_PARAMS, [this](const EcuReply & reply) {
+        QVector<uint16_t> params;
 
-    data = _readEcuParam(PARAM_DYNAMIC_OFF);
-    if (data != 0xFFFF)
-        _ui->sbDynamicOff->setValue(data);
+        if (!reply.ok) {
+            _showError("Odczyt parametrów", QString::fromUtf8("Błąd odczytu parametrów z ECU (timeout)"));
+            return;
+        }
 
-    data = _readEcuParam(PARAM_CURRENT_MAP);
-    if (data < _ui->cbCurrentMap->count())
-        _ui->cbCurrentMap->setCurrentIndex(data);
+        if (reply.exitCode != 0) {
+            _showError("Odczyt parametrów", QString::fromUtf8("Błąd odczytu parametrów z ECU (kod błędu = %1)").arg(reply.exitCode));
+            return;
+        }
 
-    data = _readEcuParam(PARAM_IMMO_ENABLED);
-    if (data != 0xFFFF)
-        _ui->cbImmoEnabled->setChecked(data != 0);
+        if (!EcuProtocol::parseParams(reply.data, &params)) {
+            qDebug() << "Wrong params" << reply.data;
+            return;
+        }
 
-    data = _readEcuParam(PARAM_CRANK_OFFSET);
-    if (data != 0xFFFF)
-        _ui->sbOffset->setValue(data);
+        _ui->sbCuttOffStart->setValue(params[PARAM_IGN_CUT_OFF_START]);
+        _ui->sbCuttOffEnd->setValue(params[PARAM_IGN_CUT_OFF_END]);
+        _ui->sbDynamicOn->setValue(params[PARAM_DYNAMIC_ON]);
+        _ui->sbDynamicOff->setValue(params[PARAM_DYNAMIC_OFF]);
+        if (params[PARAM_CURRENT_MAP] < _ui->cbCurrentMap->count())
+            _ui->cbCurrentMap->setCurrentIndex(params[PARAM_CURRENT_MAP]);
+        _ui->cbImmoEnabled->setChecked(params[PARAM_IMMO_ENABLED] != 0);
+        _ui->sbOffset->setValue(params[PARAM_CRANK_OFFSET]);
+        _ui->sbDwell->setValue(params[PARAM_DWELL_TIME]);
+        _ui->sbLimitWindow->setValue(params[PARAM_LIMIT_WINDOW]);
+    });
 
     _readImmoKeys();
 }
 
 void WndMain::_writeParams() {
-    _writeEcuParam(PARAM_IGN_CUT_OFF_START, _ui->sbCuttOffStart->value());
-    _writeEcuParam(PARAM_IGN_CUT_OFF_END, _ui->sbCuttOffEnd->value());
-    _writeEcuParam(PARAM_DYNAMIC_ON, _ui->sbDynamicOn->value());
-    _writeEcuParam(PARAM_DYNAMIC_OFF, _ui->sbDynamicOff->value());
-    _writeEcuParam(PARAM_CURRENT_MAP, _ui->cbCurrentMap->currentIndex());
-    _writeEcuParam(PARAM_IMMO_ENABLED, _ui->cbImmoEnabled->isChecked() ? 1 : 0);
-    _writeEcuParam(PARAM_CRANK_OFFSET, _ui->sbOffset->value());
+    QVector<uint16_t> params(PARAM_COUNT);
+
+    params[PARAM_IGN_CUT_OFF_START] = _ui->sbCuttOffStart->value();
+    params[PARAM_IGN_CUT_OFF_END] = _ui->sbCuttOffEnd->value();
+    params[PARAM_DYNAMIC_ON] = _ui->sbDynamicOn->value();
+    params[PARAM_DYNAMIC_OFF] = _ui->sbDynamicOff->value();
+    params[PARAM_CURRENT_MAP] = _ui->cbCurrentMap->currentIndex();
+    params[PARAM_IMMO_ENABLED] = _ui->cbImmoEnabled->isChecked() ? 1 : 0;
+    params[PARAM_CRANK_OFFSET] = _ui->sbOffset->value();
+    params[PARAM_DWELL_TIME] = _ui->sbDwell->value();
+    params[PARAM_LIMIT_WINDOW] = _ui->sbLimitWindow->value();
+
+    /* Wszystkie parametry jednym poleceniem, ECU zapisuje eeprom raz */
+    _link->command(EcuProtocol::writeParamsCommand(params), [this](const EcuReply & reply) {
+        if (!reply.ok) {
+            _showError("Zapis parametrów", QString::fromUtf8("Błąd zapisu parametrów do ECU (timeout)"));
+            return;
+        }
+
+        if (reply.exitCode != 0) {
+            _showError("Zapis parametrów", QString::fromUtf8("Błąd zapisu parametrów do ECU (kod błędu = %1)").arg(reply.exitCode));
+        }
+    });
 
     _writeImmoKeys();
 }
 
 void WndMain::_readImmoKeys() {
-    QByteArray data;
-    QStringList keys;
+    _link->command(ECU_CMD_READ_KEYS, [this](const EcuReply & reply) {
+        QStringList keys;
 
-    if (!_ecuCommand("k\r\n", NULL, &data)) {
-        return;
-    }
+        if (!reply.ok) {
+            return;
+        }
 
-    keys = QString(data.trimmed()).split(' ');
-    if (keys.count() > 0) {
-        _ui->leImmoKey0->setText(keys[0]);
-    }
+        keys = EcuProtocol::parseKeys(reply.data);
+        if (keys.count() > 0) {
+            _ui->leImmoKey0->setText(keys[0]);
+        }
 
-    if (keys.count() > 1) {
-        _ui->leImmoKey1->setText(keys[1]);
-    }
+        if (keys.count() > 1) {
+            _ui->leImmoKey1->setText(keys[1]);
+        }
+    });
 }
 
 void WndMain::_writeImmoKeys() {
-    uint8_t err;
-    QByteArray command;
-
-    command = QString("i%1 %2\r\n").arg(_ui->leImmoKey0->text(), 12, '0').arg(_ui->leImmoKey1->text(), 12, '0').toLocal8Bit();
-
-    if (!_ecuCommand(command, &err, NULL)) {
-        QMessageBox::critical(this, QString::fromUtf8("Zapis kodów immobilizera do ECU"), QString::fromUtf8("Błąd zapisu danych do ECU (timeout)"));
-        return;
-    }
+    _link->command(EcuProtocol::writeKeysCommand(_ui->leImmoKey0->text(), _ui->leImmoKey1->text()), [this](const EcuReply & reply) {
+        if (!reply.ok) {
+            _showError(QString::fromUtf8("Zapis kodów immobilizera do ECU"), QString::fromUtf8("Błąd zapisu danych do ECU (timeout)"));
+            return;
+        }
 
-    if (err != 0) {
-        QMessageBox::critical(this, QString::fromUtf8("Zapis kodów immobilizera do ECU"), QString::fromUtf8("Błąd zapisu danych do ECU (kod błędu = %1)").arg(err));
-    }
+        if (reply.exitCode != 0) {
+            _showError(QString::fromUtf8("Zapis kodów immobilizera do ECU"), QString::fromUtf8("Błąd zapisu danych do ECU (kod błędu = %1)").arg(reply.exitCode));
+        }
+    });
 }
 
 void WndMain::_setLogFile() {
-    QFile * log;
-    if (_logFile) {
-        if (_logFile->isOpen()) {
-            _logFile->close();
-        }
-
-        log = _logFile;
-        _logFile = NULL;
-        delete log;
-    }
+    _logThread->close();
+    memset(&_logStats, 0, sizeof(_logStats));
 
     _ui->lLogFileName->setText(QString::fromUtf8("Plik log: (brak)"));
-    QString fileName = QFileDialog::getSaveFileName(this, QString::fromUtf8("Wybór pliku log"), "", "*.txt");
+    QString fileName = QFileDialog::getSaveFileName(this, QString::fromUtf8("Wybór pliku log"), "", "*.etzlog");
     if (fileName.isEmpty())
         return;
 
-    log = new QFile(fileName);
+    if (QFileInfo(fileName).suffix().isEmpty()) {
+        fileName.append(".etzlog");
+    }
 
-    if (!log->open(QIODevice::WriteOnly | QIODevice::Text | QIODevice::Truncate)) {
+    if (!_logThread->open(fileName)) {
         QMessageBox::critical(this, QString::fromUtf8("Wybór pliku log"), QString::fromUtf8("Nie można otworzyć pliku %1 do zapisu!").arg(fileName));
-        delete log;
-
     }
     else {
         _ui->lLogFileName->setText(QString::fromUtf8("Plik log: %1").arg(QFileInfo(fileName).fileName()));
-        _logFile = log;
     }
+
+    _logStats = _logThread->stats();
 }
 
-bool WndMain::_ecuCommand(QByteArray command, uint8_t *exitCode, QByteArray *result) {
-    QByteArray data;
-    bool done;
+/* Konwersja logu binarnego do tekstu (format dawnego logu tekstowego) albo CSV */
+void WndMain::_convertLog() {
+    LogReader reader;
+    QString fileName, outName;
+    QFile out;
+
+    fileName = QFileDialog::getOpenFileName(this, QString::fromUtf8("Konwersja logu"), "", "*.etzlog");
+    if (fileName.isEmpty()) {
+        return;
+    }
+
+    if (!reader.open(fileName)) {
+        QMessageBox::critical(this, QString::fromUtf8("Konwersja logu"), QString::fromUtf8("Plik %1 nie jest logiem binarnym!").arg(fileName));
+        return;
+    }
 
-    _serial->write(command);
+    outName = QFileDialog::getSaveFileName(this, QString::fromUtf8("Konwersja logu"), QFileInfo(fileName).completeBaseName() + ".txt",
+                                           QString::fromUtf8("Log tekstowy (*.txt);;CSV (*.csv)"));
+    if (outName.isEmpty()) {
+        return;
+    }
 
-    if(!_serial->waitForReadyRead(1000)) { /* ECU ma sekundę na odpowiedź */
+    out.setFileName(outName);
+    if ((!out.open(QIODevice::WriteOnly | QIODevice::Text | QIODevice::Truncate)) ||
+        (!reader.exportText(&out, QFileInfo(outName).suffix().toLower() == "csv"))) {
+        QMessageBox::critical(this, QString::fromUtf8("Konwersja logu"), QString::fromUtf8("Błąd zapisu pliku %1!").arg(outName));
+        return;
+    }
+
+    _ui->statusBar->showMessage(QString::fromUtf8("Zapisano %1 próbek do %2").arg(reader.count()).arg(QFileInfo(outName).fileName()), 5000);
+}
+
+/*
+ * Wczytanie logu tekstowego:
+ * "dd-MM-yyyy hh:mm:ss.zzz obroty wyprzedzenie° przyspieszenie [przepustnica] [komórka°]"
+ * (starsze logi nie mają przepustnicy). Czasy liczone od pierwszej linii.
+ */
+bool WndMain::_loadTextLog(const QString & fileName) {
+    QFile file(fileName);
+    QDateTime start;
+
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
         return false;
     }
 
-    /* Powinniśmy dostac:
-     * \r\n
-     * Dane, linia 1\r\n
-     * Dane, linia 2\r\n
-     * ....
-     * Dane, linia n\r\n
-     * KodWyjsca>
-    */
+    _replaySamples.clear();
 
-    done = false;
+    while (!file.atEnd()) {
+        QStringList fields = QString::fromUtf8(file.readLine()).split(' ', QString::SkipEmptyParts);
+        QDateTime time;
+        LogSample sample;
+        int cell = 5;
 
-    while (!done) {
-        data = _serial->readAll();
-        //qDebug() << data;
-        if (data.isEmpty()) {
-            if (!_serial->waitForReadyRead(1000))
-                return false;
+        if (fields.count() < 5) {
             continue;
         }
 
-        /* Szukamy końca danych */
-        if (data.endsWith('>')) {
-            /* Koniec danych, odczytujemy kod błędu, jeżeli mamy go gdzie zapisać */
-            if (exitCode != NULL) {
-                *exitCode = data.right(3).left(2).toInt(0, 16);
-            }
+        time = QDateTime::fromString(fields.at(0) + " " + fields.at(1), "dd-MM-yyyy hh:mm:ss.zzz");
+        if (!time.isValid()) {
+            continue;
+        }
 
-            /* Dopisujemy reszte danych */
-            if (result != NULL) {
-                result->append(data.left(data.length() - 3));
-            }
-            done = true;
+        if (!start.isValid()) {
+            start = time;
         }
-        else {
-            /* Dopisujemy dane do wyniku */
-            if (result != NULL) {
-                result->append(data);
-            }
+
+        /* Czasy muszą rosnąć (bufor wykresu) */
+        sample.time = start.msecsTo(time) * 1000;
+        if ((!_replaySamples.isEmpty()) && (sample.time < _replaySamples.last().time)) {
+            sample.time = _replaySamples.last().time;
         }
+
+        memset(sample.values, 0, sizeof(sample.values));
+        sample.values[LOG_RPM] = fields.at(2).toInt();
+        sample.values[LOG_ADVANCE] = QString(fields.at(3)).remove(QString::fromUtf8("°")).toInt();
+        sample.values[LOG_ACCELERATION] = fields.at(4).toInt();
+        if ((fields.count() > 5) && (!fields.at(5).contains(QString::fromUtf8("°")))) {
+            sample.values[LOG_THROTTLE] = fields.at(5).toInt();
+            cell = 6;
+        }
+        sample.values[LOG_CELL] = (fields.count() > cell) ? QString(fields.at(cell)).remove(QString::fromUtf8("°")).toInt() : -1;
+
+        _replaySamples.append(sample);
     }
+
     return true;
 }
 
-uint16_t WndMain::_readEcuParam(int id) {
-    uint8_t err;
-    QByteArray data;
+/* Odtwarzanie logu (binarnego albo tekstowego) na wykresie w czasie rzeczywistym, drugie kliknięcie zatrzymuje */
+void WndMain::_replayLog() {
+    QString fileName;
+
+    if (_replayTimer->isActive()) {
+        _stopReplay();
+        return;
+    }
+
+    fileName = QFileDialog::getOpenFileName(this, QString::fromUtf8("Odtwarzanie logu"), "", QString::fromUtf8("Log (*.etzlog *.txt)"));
+    if (fileName.isEmpty()) {
+        return;
+    }
+
+    _replayReader.close();
+    if (LogReader::isBinaryLog(fileName) ? (!_replayReader.open(fileName)) : (!_loadTextLog(fileName))) {
+        QMessageBox::critical(this, QString::fromUtf8("Odtwarzanie logu"), QString::fromUtf8("Nie można otworzyć pliku %1!").arg(fileName));
+        return;
+    }
+
+    /* Przewijanie tylko w logu binarnym (indeks paczek) */
+    _ui->hsReplay->blockSignals(true);
+    _ui->hsReplay->setRange(0, _replayReader.duration() / 100000);
+    _ui->hsReplay->setValue(0);
+    _ui->hsReplay->blockSignals(false);
+    _ui->hsReplay->setEnabled(_replayReader.isOpen());
+
+    _replaySeek(0);
+}
+
+/* Odtwarzanie od czasu logu [0.1 s] (suwak) */
+void WndMain::_replaySeek(int position) {
+    qint64 time = position * 100000LL;
 
-    if (!_ecuCommand(QString("g%1\r\n").arg(id, 2, 16, QLatin1Char('0')).toLocal8Bit(), &err, &data)) {
-        QMessageBox::critical(this, "Odczyt parametru", QString::fromUtf8("Błąd odczytu parametru %1 z ECU (timeout)").arg(id));
-        return 0xFFFF;
+    if (_replayReader.isOpen()) {
+        _replayChunk = _replayReader.findChunk(time);
+        _replayReader.readChunk(_replayChunk, &_replaySamples);
     }
 
-    if (err != 0) {
-        QMessageBox::critical(this, "Odczyt parametru", QString::fromUtf8("Błąd odczytu parametru %1 z ECU (kod błędu = %2)").arg(id).arg(err));
-        return 0xFFFF;
+    for(_replayPos = 0; (_replayPos < _replaySamples.count()) && (_replaySamples.at(_replayPos).time < time); _replayPos++);
+
+    _ui->wPlot->clear();
+    _replayShown = true;
+    _replayOffset = time;
+    _replayClock.start();
+    _replayTimer->start();
+    _ui->pbReplayLog->setText(QString::fromUtf8("Zatrzymaj odtwarzanie"));
+}
+
+void WndMain::_replayStep() {
+    qint64 now = _replayOffset + _replayClock.nsecsElapsed() / 1000;
+
+    for(;;) {
+        while ((_replayPos < _replaySamples.count()) && (_replaySamples.at(_replayPos).time <= now)) {
+            _plotSample(_replaySamples.at(_replayPos));
+            _replayPos++;
+        }
+
+        if (_replayPos < _replaySamples.count()) {
+            break;
+        }
+
+        /* Koniec paczki - następna z logu binarnego */
+        if ((!_replayReader.isOpen()) || (_replayChunk + 1 >= _replayReader.chunks()) || (!_replayReader.readChunk(++_replayChunk, &_replaySamples))) {
+            _replayTimer->stop();
+            _ui->pbReplayLog->setText(QString::fromUtf8("Odtwórz log..."));
+            break;
+        }
+        _replayPos = 0;
+    }
+
+    if (!_ui->hsReplay->isSliderDown()) {
+        _ui->hsReplay->blockSignals(true);
+        _ui->hsReplay->setValue(now / 100000);
+        _ui->hsReplay->blockSignals(false);
     }
+}
 
-    return data.trimmed().toUInt(0, 16);
+/* Przerwanie odtwarzania, wykres wraca do danych na żywo (od zera - czasy w buforze muszą rosnąć) */
+void WndMain::_stopReplay() {
+    _replayTimer->stop();
+    _ui->pbReplayLog->setText(QString::fromUtf8("Odtwórz log..."));
+    _clearPlot();
 }
 
-void WndMain::_writeEcuParam(int id, uint16_t value) {
-    uint8_t err;
+void WndMain::_clearPlot() {
+    _replayShown = false;
+    _ui->wPlot->clear();
+    _plotClock.restart();
+}
 
-    if (!_ecuCommand(QString("s%1%2\r\n").arg(id, 2, 16, QLatin1Char('0')).arg(value, 4, 16, QLatin1Char('0')).toLocal8Bit(), &err, NULL)) {
-        QMessageBox::critical(this, "Zapis parametru", QString::fromUtf8("Błąd zapisu parametru %1 do ECU (kod błędu = %2)").arg(id).arg(err));
-        return;
+void WndMain::_plotSample(const LogSample & sample) {
+    float values[PLOT_CHANNELS];
+
+    values[PLOT_RPM] = sample.values[LOG_RPM];
+    values[PLOT_ADVANCE] = sample.values[LOG_ADVANCE];
+    values[PLOT_ACCELERATION] = sample.values[LOG_ACCELERATION];
+    values[PLOT_THROTTLE] = sample.values[LOG_THROTTLE];
+    _ui->wPlot->append(sample.time / 1e6, values);
+}
+
+void WndMain::_mapAxesEdited() {
+    QList<int> rpmAxis, loadAxis;
+
+    rpmAxis = EcuProtocol::parseAxis(_ui->leRpmAxis->text(), MAP_RPM_SIZE, 0xFFFF);
+    loadAxis = EcuProtocol::parseAxis(_ui->leLoadAxis->text(), MAP_LOAD_SIZE, MAP_LOAD_MAX);
+
+    if ((!rpmAxis.isEmpty()) && (!loadAxis.isEmpty())) {
+        _setMapAxes(rpmAxis, loadAxis);
     }
 }
+
+void WndMain::_setMapAxes(const QList<int> & rpmAxis, const QList<int> & loadAxis) {
+    QStringList rpmLabels, loadLabels, rowLabels;
+
+    _rpmAxis = rpmAxis;
+    _loadAxis = loadAxis;
+
+    foreach (int value, _rpmAxis) {
+        rpmLabels.append(QString::number(value));
+    }
+
+    foreach (int value, _loadAxis) {
+        loadLabels.append(QString::number(value));
+    }
+
+    for(int map = 0; map < MAP_COUNT; map++) {
+        foreach (int value, _loadAxis) {
+            rowLabels.append(QString::fromUtf8("%1 / %2%").arg(map + 1).arg((value * 100) / MAP_LOAD_MAX));
+        }
+    }
+
+    _ui->twIgnitionMap->setHorizontalHeaderLabels(rpmLabels);
+    _ui->twIgnitionMap->setVerticalHeaderLabels(rowLabels);
+    _ui->leRpmAxis->setText(rpmLabels.join(" "));
+    _ui->leLoadAxis->setText(loadLabels.join(" "));
+}
+
+/* Numer przedziału osi, w którym jest wartość (ostatni punkt nie większy od wartości) */
+int WndMain::_axisBin(const QList<int> & axis, int value) {
+    int bin = 0;
+
+    for(int i = 1; i < axis.count(); i++) {
+        if (value >= axis.at(i)) {
+            bin = i;
+        }
+    }
+
+    return bin;
+}
+
+/* Komunikat o błędzie bez blokowania (callbacki poleceń nie mogą czekać w QMessageBox::exec()) */
+void WndMain::_showError(const QString & title, const QString & text) {
+    QMessageBox * box = new QMessageBox(QMessageBox::Critical, title, text, QMessageBox::Ok, this);
+
+    box->setAttribute(Qt::WA_DeleteOnClose);
+    box->show();
+}
@@ -2,20 +2,27 @@
 #define WNDMAIN_H
 
 #include <QMainWindow>
-#include <QtSerialPort/QSerialPort>
 #include <QtSerialPort/QSerialPortInfo>
 #include <QTimer>
 #include <QFile>
+#include <QList>
+#include <QLabel>
+#include <QVector>
+#include <QTableWidgetItem>
+#include <QElapsedTimer>
 #include <stdint.h>
-
-#define PARAM_IGN_CUT_OFF_START  0
-#define PARAM_IGN_CUT_OFF_END    1
-#define PARAM_DYNAMIC_ON         2
-#define PARAM_DYNAMIC_OFF        3
-#define PARAM_CURRENT_MAP        4
-#define PARAM_IMMO_ENABLED       5
-#define PARAM_CRANK_OFFSET       6
-#define PARAM_COUNT              7
+#include "ecuframe.h"
+#include "eculink.h"
+#include "ecuprotocol.h"
+#include "plotwidget.h"
+#include "eculog.h"
+#include "logthread.h"
+
+/* Kanały wykresu */
+#define PLOT_RPM                 0
+#define PLOT_ADVANCE             1
+#define PLOT_ACCELERATION        2
+#define PLOT_THROTTLE            3
 
 namespace Ui {
     class WndMain;
@@ -48,17 +55,57 @@ private slots:
 
     void _setLogFile(void);
 
+    void _mapAxesEdited(void);
+    void _mapCellEdited(QTableWidgetItem * item);
+
+    void _setStreaming(bool enabled);
+    void _replayLog(void);
+    void _replaySeek(int position);
+    void _replayStep(void);
+    void _clearPlot(void);
+    void _convertLog(void);
+    void _frameReceived(const EcuFrame & frame);
+    void _updateLinkStats(void);
+
 private:
     Ui::WndMain * _ui;
     QTimer * _connectTimer;
     QTimer * _liveDataTimer;
-
-    QSerialPort * _serial;
-    QFile * _logFile;
-
-    bool _ecuCommand(QByteArray command, uint8_t * exitCode, QByteArray * result);
-    uint16_t _readEcuParam(int id);
-    void _writeEcuParam(int id, uint16_t value);
+    QTimer * _streamWatchdog;
+    QTimer * _statsTimer;
+    QLabel * _lLinkStats;
+    QLabel * _lLogStats;
+
+    EcuLink * _link;
+    bool _livePending;
+    LogThread * _logThread;
+    LogThreadStats _logStats; /* Liczniki z poprzedniego odświeżenia paska stanu */
+
+    QList<int> _rpmAxis;
+    QList<int> _loadAxis;
+    QVector<int> _ecuMap; /* Wartości komórek mapy w ECU (-1 - nieznana), edycja na żywo wysyła tylko zmiany */
+    int _activeRow; /* Podświetlona komórka mapy (-1 - brak), przy nowych danych odświeżane są tylko zmienione komórki */
+    int _activeCol;
+
+    QElapsedTimer _plotClock; /* Czas próbek na żywo na wykresie */
+    QTimer * _replayTimer;
+    QElapsedTimer _replayClock;
+    qint64 _replayOffset; /* Czas logu przy starcie _replayClock [us] */
+    LogReader _replayReader; /* Odtwarzany log binarny (zamknięty - log tekstowy w całości w _replaySamples) */
+    QVector<LogSample> _replaySamples; /* Bieżąca paczka logu binarnego */
+    int _replayChunk;
+    int _replayPos;
+    bool _replayShown; /* Wykres pokazuje log, nie dane na żywo */
+
+    void _showLiveData(const LiveData & data);
+    void _stopReplay(void);
+    bool _loadTextLog(const QString & fileName);
+    void _plotSample(const LogSample & sample);
+    void _setCellColor(int row, int col, const QColor & color);
+    void _showError(const QString & title, const QString & text);
+
+    void _setMapAxes(const QList<int> & rpmAxis, const QList<int> & loadAxis);
+    static int _axisBin(const QList<int> & axis, int value);
 
 };
 
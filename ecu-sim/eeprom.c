@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+
+/* Emulowany EEPROM atmega32u4 z licznikiem zapisów każdej komórki */
+
+uint8_t __sim_eeprom[E2END + 1];
+uint32_t __sim_eeprom_writes[E2END + 1];
+
+static long _cut = -1; /* Ilość zapisów do zaniku zasilania, -1 - bez zaniku */
+
+static uintptr_t sim_eeprom_addr(const void * addr, size_t n) {
+	uintptr_t a = (uintptr_t)addr;
+
+	if (a + n > E2END + 1) {
+		fprintf(stderr, "Dostep poza eeprom: 0x%lx (%lu B)\n", (unsigned long)a, (unsigned long)n);
+		abort();
+	}
+
+	return a;
+}
+
+uint8_t eeprom_read_byte(const uint8_t * addr) {
+	return __sim_eeprom[sim_eeprom_addr(addr, 1)];
+}
+
+uint16_t eeprom_read_word(const uint16_t * addr) {
+	uintptr_t a = sim_eeprom_addr(addr, 2);
+
+	return __sim_eeprom[a] | (__sim_eeprom[a + 1] << 8);
+}
+
+void eeprom_read_block(void * dst, const void * src, size_t n) {
+	memcpy(dst, &__sim_eeprom[sim_eeprom_addr(src, n)], n);
+}
+
+void eeprom_write_byte(uint8_t * addr, uint8_t value) {
+	uintptr_t a = sim_eeprom_addr(addr, 1);
+
+	if (!_cut) /* Brak zasilania */
+		return;
+
+	if ((_cut > 0) && (!--_cut)) /* Zanik zasilania w trakcie zapisu - wartość bajtu nieokreślona */
+		value = rand();
+
+	__sim_eeprom[a] = value;
+	__sim_eeprom_writes[a]++;
+}
+
+void eeprom_update_block(const void * src, void * dst, size_t n) {
+	const uint8_t * p = src;
+	uintptr_t a = sim_eeprom_addr(dst, n);
+	size_t i;
+
+	for(i = 0; i < n; i++) {
+		if (__sim_eeprom[a + i] != p[i])
+			eeprom_write_byte((uint8_t *)(a + i), p[i]);
+	}
+}
+
+/* Czysty eeprom (same 0xFF), liczniki zapisów wyzerowane */
+void sim_eeprom_erase(void) {
+	memset(__sim_eeprom, 0xFF, sizeof(__sim_eeprom));
+	memset(__sim_eeprom_writes, 0, sizeof(__sim_eeprom_writes));
+	_cut = -1;
+}
+
+/* Wykonanie zapisu w tle do końca (przerwania EE_READY) */
+void sim_eeprom_flush(void) {
+	while (EECR & (1 << EERIE))
+		EE_READY_vect();
+}
+
+/* Zanik zasilania po podanej ilości zapisów bajtów (-1 - wyłączony) */
+void sim_eeprom_cut(long writes) {
+	_cut = writes;
+}
+
+unsigned long sim_eeprom_total_writes(void) {
+	unsigned long total = 0;
+	int i;
+
+	for(i = 0; i <= E2END; i++)
+		total += __sim_eeprom_writes[i];
+
+	return total;
+}
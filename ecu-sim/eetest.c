@@ -0,0 +1,269 @@
+/*
+ * Test zapisu konfiguracji do eeprom (src/storage.c) na emulowanym eeprom.
+ *
+ * 1. Zużycie - symulacja pracy z diag-app: wielokrotny zapis parametrów,
+ *    zmiana kilku komórek mapy, co jakiś czas zmiana osi i kluczy immo.
+ *    Wypisywana jest ilość zapisanych bajtów i największa ilość zapisów jednej
+ *    komórki w porównaniu z poprzednim układem (każdy obszar w jednym stałym
+ *    miejscu, eeprom_update_block).
+ * 2. Zanik zasilania - zapis nowej mapy i parametrów przerywany po losowej
+ *    ilości zapisanych bajtów (ostatni zapisany bajt ma losową wartość). Po
+ *    ponownym uruchomieniu każdy obszar musi zawierać całą poprzednią albo
+ *    całą nową wersję.
+ * 3. Zmiana danych w trakcie zapisu - po ponownym uruchomieniu musi być
+ *    wczytana ostatnia wersja.
+ *
+ * Użycie: ecu-eeprom [-n ilość] [-r ziarno]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include "storage.h"
+#include "params.h"
+#include "map.h"
+#include "immo.h"
+
+#define EETEST_MAP_CELLS    4  /* Ilość komórek mapy zmienianych przy każdym zapisie */
+#define EETEST_AXES_EVERY   10 /* Co który zapis zmieniane są osie */
+#define EETEST_IMMO_EVERY   50 /* Co który zapis zmieniane są klucze immo */
+
+struct eetest_config {
+	uint16_t params[PARAM_COUNT];
+	uint8_t map[MAP_COUNT][MAP_LOAD_SIZE][MAP_RPM_SIZE];
+	uint16_t rpm_axis[MAP_RPM_SIZE];
+	uint16_t load_axis[MAP_LOAD_SIZE];
+	uint8_t keys[IMMO_KEYS][IMMO_KEY_LEN + 1];
+};
+
+static unsigned long _errors;
+
+/* Poprzedni układ - obszary w stałych miejscach, zapisywane są tylko zmienione bajty */
+static struct eetest_config _old_eeprom;
+static uint32_t _old_writes[sizeof(struct eetest_config)];
+
+static void eetest_old_save(void) {
+	uint8_t * dst = (uint8_t *)&_old_eeprom;
+	uint8_t * src;
+	size_t i, r;
+	struct { void * data; size_t size; size_t offset; } regions[] = {
+		{ __params, sizeof(__params), offsetof(struct eetest_config, params) },
+		{ __ignition_map, sizeof(__ignition_map), offsetof(struct eetest_config, map) },
+		{ __map_rpm_axis, sizeof(__map_rpm_axis), offsetof(struct eetest_config, rpm_axis) },
+		{ __map_load_axis, sizeof(__map_load_axis), offsetof(struct eetest_config, load_axis) },
+		{ __immo_keys, sizeof(__immo_keys), offsetof(struct eetest_config, keys) },
+	};
+
+	for(r = 0; r < sizeof(regions) / sizeof(regions[0]); r++) {
+		src = regions[r].data;
+		for(i = 0; i < regions[r].size; i++) {
+			if (dst[regions[r].offset + i] != src[i]) {
+				dst[regions[r].offset + i] = src[i];
+				_old_writes[regions[r].offset + i]++;
+			}
+		}
+	}
+}
+
+static void eetest_get(struct eetest_config * c) {
+	memcpy(c->params, __params, sizeof(c->params));
+	memcpy(c->map, __ignition_map, sizeof(c->map));
+	memcpy(c->rpm_axis, __map_rpm_axis, sizeof(c->rpm_axis));
+	memcpy(c->load_axis, __map_load_axis, sizeof(c->load_axis));
+	memcpy(c->keys, __immo_keys, sizeof(c->keys));
+}
+
+/* Ponowne uruchomienie - RAM wyczyszczony, konfiguracja wczytana z eeprom */
+static void eetest_reboot(void) {
+	memset(__params, 0, sizeof(__params));
+	memset(__ignition_map, 0, sizeof(__ignition_map));
+	memset(__map_rpm_axis, 0, sizeof(__map_rpm_axis));
+	memset(__map_load_axis, 0, sizeof(__map_load_axis));
+	memset(__immo_keys, 0, sizeof(__immo_keys));
+
+	storage_init();
+	params_init();
+	map_init();
+	storage_load(STORAGE_IMMO);
+}
+
+/* Losowa zmiana konfiguracji i zlecenie zapisu (tak jak polecenia 'S', 'w', 'y', 'i') */
+static void eetest_change(unsigned long n, int all) {
+	uint16_t rpm_axis[MAP_RPM_SIZE], load_axis[MAP_LOAD_SIZE];
+	int i;
+
+	__params[PARAM_IGN_CUT_OFF_START] = 7000 + rand() % 1000;
+	__params[PARAM_CRANK_OFFSET] = rand() % 40;
+	params_save();
+
+	map_stage();
+	for(i = 0; i < (all ? MAP_ROWS * MAP_RPM_SIZE : EETEST_MAP_CELLS); i++)
+		((uint8_t *)__map_staging)[rand() % sizeof(__map_staging)] = rand() % (MAP_ADVANCE_MAX + 1);
+	map_commit();
+
+	if ((all) || (!(n % EETEST_AXES_EVERY))) {
+		for(i = 0; i < MAP_RPM_SIZE; i++)
+			rpm_axis[i] = 250 + i * 500 + rand() % 100;
+		for(i = 0; i < MAP_LOAD_SIZE; i++)
+			load_axis[i] = i * 300 + rand() % 100;
+		map_set_axes(rpm_axis, load_axis);
+	}
+
+	if ((all) || (!(n % EETEST_IMMO_EVERY))) {
+		for(i = 0; i < IMMO_KEY_LEN; i++)
+			__immo_keys[rand() % IMMO_KEYS][i] = "0123456789ABCDEF"[rand() & 0x0F];
+		storage_save(STORAGE_IMMO); /* immo_keys_save() - immo.c nie jest kompilowany w symulatorze */
+	}
+}
+
+static void eetest_wear(long count) {
+	unsigned long old_total = 0, old_max = 0, new_max = 0;
+	size_t i;
+	long n;
+
+	sim_eeprom_erase();
+	eetest_reboot();
+	memset(&_old_eeprom, 0xFF, sizeof(_old_eeprom));
+	memset(_old_writes, 0, sizeof(_old_writes));
+
+	for(n = 0; n < count; n++) {
+		eetest_change(n, 0);
+		sim_eeprom_flush();
+		eetest_old_save();
+	}
+
+	for(i = 0; i < sizeof(_old_writes) / sizeof(_old_writes[0]); i++) {
+		old_total += _old_writes[i];
+		if (_old_writes[i] > old_max)
+			old_max = _old_writes[i];
+	}
+
+	for(i = 0; i <= E2END; i++) {
+		if (__sim_eeprom_writes[i] > new_max)
+			new_max = __sim_eeprom_writes[i];
+	}
+
+	printf("wear: %ld zapisow, stary uklad %lu B (max %lu na komorke), dziennik %lu B (max %lu na komorke)\n",
+	       count, old_total, old_max, sim_eeprom_total_writes(), new_max);
+}
+
+/* Porównanie wczytanej konfiguracji z poprzednią i nową wersją, zwraca 1 gdy wczytana jest nowa */
+static int eetest_check(const struct eetest_config * prev, const struct eetest_config * next, long cut) {
+	struct eetest_config c;
+	int done = 1;
+
+	eetest_get(&c);
+
+#define EETEST_REGION(field) \
+	if (!memcmp(c.field, next->field, sizeof(c.field))) { \
+	} else if (!memcmp(c.field, prev->field, sizeof(c.field))) { \
+		done = 0; \
+	} else { \
+		fprintf(stderr, "Uszkodzony obszar " #field " po zaniku zasilania (zapis %ld)\n", cut); \
+		_errors++; \
+	}
+
+	EETEST_REGION(params);
+	EETEST_REGION(map);
+	EETEST_REGION(rpm_axis);
+	EETEST_REGION(load_axis);
+	EETEST_REGION(keys);
+
+#undef EETEST_REGION
+
+	return done;
+}
+
+static void eetest_power_cut(long count) {
+	struct eetest_config prev, next;
+	unsigned long completed = 0;
+	long n, cut;
+
+	for(n = 0; n < count; n++) {
+		sim_eeprom_erase();
+		eetest_reboot();
+		eetest_change(0, 1);
+		sim_eeprom_flush();
+		eetest_get(&prev);
+
+		eetest_change(0, 1);
+		eetest_get(&next);
+
+		/* Pełny zapis to około sizeof(struct eetest_config) bajtów, część zapisów przerywamy */
+		cut = 1 + rand() % (sizeof(struct eetest_config) + sizeof(struct eetest_config) / 4);
+		sim_eeprom_cut(cut);
+		sim_eeprom_flush();
+		sim_eeprom_cut(-1);
+
+		eetest_reboot();
+		completed += eetest_check(&prev, &next, cut);
+	}
+
+	printf("power cut: %ld prob, %lu zapisow dokonczonych, %lu bledow\n", count, completed, _errors);
+}
+
+static void eetest_restart(long count) {
+	struct eetest_config next;
+	long n, steps;
+
+	for(n = 0; n < count; n++) {
+		sim_eeprom_erase();
+		eetest_reboot();
+		eetest_change(0, 1);
+
+		/* Część zapisu, potem nowe dane */
+		for(steps = rand() % 400; (steps > 0) && (storage_busy()); steps--)
+			EE_READY_vect();
+
+		eetest_change(1, 0);
+		eetest_get(&next);
+		sim_eeprom_flush();
+
+		eetest_reboot();
+		eetest_check(&next, &next, -1);
+	}
+
+	printf("restart: %ld prob, %lu bledow\n", count, _errors);
+}
+
+static void usage(const char * name) {
+	fprintf(stderr, "Uzycie: %s [-n ilosc] [-r ziarno]\n", name);
+	fprintf(stderr, "  -n  ilosc zapisow (proby zaniku zasilania / 10)\n");
+	fprintf(stderr, "  -r  ziarno generatora liczb losowych\n");
+}
+
+int main(int argc, char * argv[]) {
+	long count = 10000;
+	unsigned int seed = 1;
+	int opt;
+
+	while((opt = getopt(argc, argv, "n:r:h")) != -1) {
+		switch(opt) {
+			case 'n': {
+				count = atol(optarg);
+				break;
+			}
+			case 'r': {
+				seed = atoi(optarg);
+				break;
+			}
+			default: {
+				usage(argv[0]);
+				return 1;
+			}
+		}
+	}
+
+	srand(seed);
+
+	eetest_wear(count);
+	eetest_power_cut(count / 10);
+	eetest_restart(count / 10);
+
+	return _errors ? 1 : 0;
+}
@@ -0,0 +1,413 @@
+/*
+ * Emulator ECU na pseudoterminalu (Linux).
+ *
+ * Uruchamia cały firmware - pętlę główną z src/main.c i interfejs z
+ * src/interface.c - z emulowanym LUFA (include/LUFA/Drivers/USB/USB.h):
+ * endpoint OUT czytany jest z pseudoterminala, endpoint IN do niego zapisywany.
+ * Program wypisuje nazwę urządzenia (/dev/pts/N), które można otworzyć w
+ * diag-app albo ecu-cli zamiast prawdziwego ECU.
+ *
+ * Czas symulowany nadąża za rzeczywistym: po każdym przebiegu pętli głównej
+ * (USB_USBTask) wykonywane są tyknięcia timera, które w tym czasie upłynęły -
+ * wał, timer 1, ADC i zapis eeprom w tle emulowane są jak w ecu-sim. Obroty są
+ * stałe albo (-w) zmieniają się od EMU_RPM_IDLE do zadanych i z powrotem co
+ * EMU_SWEEP_PERIOD sekund, razem z położeniem przepustnicy.
+ *
+ * Bez pliku eeprom (-f) ECU startuje z mapą i parametrami testowymi. Z plikiem
+ * eeprom jest z niego wczytywany (jeżeli istnieje) i zapisywany przy wyjściu
+ * (SIGINT / SIGTERM), więc zapisane mapy i parametry zostają do następnego
+ * uruchomienia. Kody immobilizera nie są zapisywane (stubs.c).
+ *
+ * Użycie: ecu-emu [-r obroty] [-w] [-f plik] [-l dowiązanie]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <signal.h>
+#include <termios.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <LUFA/Drivers/USB/USB.h>
+#include "map.h"
+#include "params.h"
+
+#define EMU_TICKS_PER_SEC   (F_CPU / 64UL)
+#define EMU_EPSIZE          64    /* Jak CDC_TXRX_EPSIZE w Descriptors.h */
+#define EMU_MAX_CATCHUP     (EMU_TICKS_PER_SEC / 10) /* Najwięcej tyknięć na przebieg pętli (po zatrzymaniu procesu czas nie jest nadrabiany) */
+#define EMU_POLL_MS         1     /* Czekanie na dane z pseudoterminala w przebiegu pętli [ms] */
+#define EMU_ADC_TICKS       13
+#define EMU_ADC_TEMP        500
+#define EMU_ADC_THROTTLE    300
+#define EMU_RPM_IDLE        1500
+#define EMU_SWEEP_PERIOD    10.0  /* [s] */
+
+int ecu_main(void);
+
+volatile uint8_t USB_DeviceState = DEVICE_STATE_Unattached;
+
+static const uint8_t _test_map[MAP_RPM_SIZE] = {
+	8, 10, 12, 14, 16, 18, 20, 22, 24, 25, 26, 27, 28, 28, 28, 28
+};
+
+static const uint16_t _test_params[PARAM_COUNT] = {
+	[PARAM_IGN_CUT_OFF_START] = 7800,
+	[PARAM_IGN_CUT_OFF_END]   = 7600,
+	[PARAM_DYNAMIC_ON]        = 1000,
+	[PARAM_DYNAMIC_OFF]       = 800,
+	[PARAM_CURRENT_MAP]       = 0,
+	[PARAM_IMMO_ENABLED]      = 0,
+	[PARAM_CRANK_OFFSET]      = 6,
+	[PARAM_DWELL_TIME]        = 3000,
+	[PARAM_LIMIT_WINDOW]      = 200,
+};
+
+static int _pty = -1;
+static const char * _eeprom_file;
+static const char * _link;
+static double _rpm = EMU_RPM_IDLE;
+static int _sweep;
+static volatile sig_atomic_t _quit;
+
+static USB_ClassInfo_CDC_Device_t * _cdc;
+static uint8_t _in[EMU_EPSIZE], _out[EMU_EPSIZE];
+static uint16_t _in_len, _out_len, _out_pos;
+static unsigned long _in_dropped; /* Bajty odrzucone przy pełnym buforze pseudoterminala (nikt nie czyta) */
+
+static double _start_ns;
+static unsigned long _tick;
+static double _theta;
+static long _last_half;
+static unsigned int _adc_ticks;
+static int _started;
+static int _loaded; /* Eeprom wczytany z pliku */
+
+static inline double emu_now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Obroty i przepustnica (0 - 1) w chwili t [s] */
+static double emu_profile(double t, double * throttle) {
+	double a = 0.0;
+
+	if (_sweep) {
+		a = t / EMU_SWEEP_PERIOD - (long)(t / EMU_SWEEP_PERIOD);
+		a = (a < 0.5) ? 2.0 * a : 2.0 - 2.0 * a;
+	}
+
+	*throttle = a;
+	return _sweep ? EMU_RPM_IDLE + a * (_rpm - EMU_RPM_IDLE) : _rpm;
+}
+
+/* Tyknięcia timera od poprzedniego wywołania - wał, timer 1, ADC, eeprom */
+static void emu_step(unsigned long ticks) {
+	double t, rpm, throttle;
+	long half;
+
+	while (ticks--) {
+		_tick++;
+		t = (double)_tick / EMU_TICKS_PER_SEC;
+		rpm = emu_profile(t, &throttle);
+
+		if (TCCR1B & ((1 << CS10) | (1 << CS11) | (1 << CS12))) {
+			if ((++TCNT1 == 0) && (TIMSK1 & (1 << TOIE1)))
+				TIMER1_OVF_vect();
+			if ((TCNT1 == OCR1A) && (TIMSK1 & (1 << OCIE1A)))
+				TIMER1_COMPA_vect();
+			if ((TCNT1 == OCR1B) && (TIMSK1 & (1 << OCIE1B)))
+				TIMER1_COMPB_vect();
+		}
+
+		if ((ADCSRA & (1 << ADEN)) && (ADCSRA & (1 << ADSC)) && (++_adc_ticks >= EMU_ADC_TICKS)) {
+			_adc_ticks = 0;
+			ADC = (ADMUX & (1 << MUX0)) ? (_sweep ? 100 + throttle * 800 : EMU_ADC_THROTTLE) : EMU_ADC_TEMP;
+			ADCSRA &= ~(1 << ADSC);
+			if (ADCSRA & (1 << ADIE))
+				ADC_vect();
+		}
+
+		if (EECR & (1 << EERIE))
+			EE_READY_vect();
+
+		_theta += rpm * 6.0 / EMU_TICKS_PER_SEC;
+		half = (long)(_theta / 180.0);
+		if (half != _last_half) {
+			_last_half = half;
+			if (half & 1) { /* DMP */
+				if (EIMSK & (1 << INT0))
+					INT0_vect();
+			}
+			else if (EIMSK & (1 << INT1)) { /* GMP */
+				INT1_vect();
+			}
+		}
+	}
+}
+
+/* Mapa i parametry testowe (pusty eeprom, po init() z ecu_main) */
+static void emu_defaults(void) {
+	int i, j;
+
+	memcpy(__params, _test_params, sizeof(__params));
+	params_save();
+
+	for(i = 0; i < MAP_COUNT; i++) {
+		for(j = 0; j < MAP_LOAD_SIZE; j++)
+			memcpy(__ignition_map[i][j], _test_map, MAP_RPM_SIZE);
+	}
+	map_write();
+}
+
+static void emu_load_eeprom(void) {
+	FILE * f;
+
+	sim_eeprom_erase();
+	if ((!_eeprom_file) || (!(f = fopen(_eeprom_file, "rb"))))
+		return;
+
+	if (fread(__sim_eeprom, 1, sizeof(__sim_eeprom), f) != sizeof(__sim_eeprom))
+		fprintf(stderr, "Niepelny plik eeprom %s, reszta pusta\n", _eeprom_file);
+	fclose(f);
+	_loaded = 1;
+}
+
+static void emu_exit(void) {
+	FILE * f;
+
+	sim_eeprom_flush();
+	if ((_eeprom_file) && (f = fopen(_eeprom_file, "wb"))) {
+		fwrite(__sim_eeprom, 1, sizeof(__sim_eeprom), f);
+		fclose(f);
+		printf("Zapisano eeprom do %s (%lu zapisow bajtow)\n", _eeprom_file, sim_eeprom_total_writes());
+	}
+
+	if (_link)
+		unlink(_link);
+
+	if (_in_dropped)
+		printf("Odrzucono %lu B odpowiedzi (pseudoterminal nieotwarty)\n", _in_dropped);
+
+	exit(0);
+}
+
+static void emu_signal(int sig) {
+	(void)sig;
+	_quit = 1;
+}
+
+/* Pseudoterminal w trybie surowym, strona podrzędna zostaje otwarta (brak EIO, gdy nikt jej nie używa) */
+static int emu_open_pty(void) {
+	struct termios tio;
+	const char * name;
+	int slave;
+
+	_pty = posix_openpt(O_RDWR | O_NOCTTY);
+	if ((_pty < 0) || (grantpt(_pty)) || (unlockpt(_pty)) || (!(name = ptsname(_pty)))) {
+		perror("posix_openpt");
+		return -1;
+	}
+
+	slave = open(name, O_RDWR | O_NOCTTY);
+	if ((slave < 0) || (tcgetattr(slave, &tio))) {
+		perror(name);
+		return -1;
+	}
+	cfmakeraw(&tio);
+	tcsetattr(slave, TCSANOW, &tio);
+
+	fcntl(_pty, F_SETFL, fcntl(_pty, F_GETFL) | O_NONBLOCK);
+
+	if (_link) {
+		unlink(_link);
+		if (symlink(name, _link)) {
+			perror(_link);
+			_link = NULL;
+		}
+	}
+
+	printf("ECU na %s%s%s\n", name, _link ? " -> " : "", _link ? _link : "");
+	fflush(stdout);
+	return 0;
+}
+
+/* LUFA */
+
+void USB_Init(void) {
+	USB_DeviceState = DEVICE_STATE_Configured;
+	EVENT_USB_Device_ConfigurationChanged();
+	EVENT_USB_Device_Connect();
+}
+
+/* Koniec przebiegu pętli głównej - czekanie na dane, potem czas symulowany do bieżącego */
+void USB_USBTask(void) {
+	struct pollfd pfd;
+	unsigned long now;
+
+	if (!_started) { /* Pierwszy przebieg, init() już wczytało eeprom */
+		_started = 1;
+		if (!_loaded)
+			emu_defaults();
+		_start_ns = emu_now_ns();
+	}
+
+	if (_quit)
+		emu_exit();
+
+	pfd.fd = _pty;
+	pfd.events = POLLIN;
+	poll(&pfd, 1, (_out_len > _out_pos) ? 0 : EMU_POLL_MS);
+
+	now = (unsigned long)((emu_now_ns() - _start_ns) * EMU_TICKS_PER_SEC / 1e9);
+	if (now - _tick > EMU_MAX_CATCHUP)
+		_tick = now - EMU_MAX_CATCHUP;
+	emu_step(now - _tick);
+}
+
+/* Czas z ramek SOF (co 1 ms), z czasu symulowanego */
+uint16_t USB_Device_GetFrameNumber(void) {
+	return (uint16_t)(_tick * 1000UL / EMU_TICKS_PER_SEC) & 0x07FF;
+}
+
+/* IN i OUT to osobne bufory, wybór endpointu nie jest potrzebny */
+void Endpoint_SelectEndpoint(uint8_t address) {
+	(void)address;
+}
+
+bool Endpoint_IsReadWriteAllowed(void) {
+	return _in_len < sizeof(_in);
+}
+
+/* Wysłanie pakietu IN, przy pełnym pseudoterminalu reszta przepada (jak bez hosta) */
+void Endpoint_ClearIN(void) {
+	uint16_t pos = 0;
+	ssize_t n;
+
+	while (pos < _in_len) {
+		n = write(_pty, &_in[pos], _in_len - pos);
+		if (n > 0) {
+			pos += n;
+		}
+		else if ((n < 0) && (errno == EINTR)) {
+			continue;
+		}
+		else {
+			_in_dropped += _in_len - pos;
+			break;
+		}
+	}
+
+	_in_len = 0;
+}
+
+uint8_t Endpoint_WaitUntilReady(void) {
+	return ENDPOINT_READYWAIT_NoError;
+}
+
+void Endpoint_Write_8(uint8_t data) {
+	if (_in_len < sizeof(_in))
+		_in[_in_len++] = data;
+}
+
+bool Endpoint_IsOUTReceived(void) {
+	ssize_t n;
+
+	if (_out_pos < _out_len)
+		return 1;
+
+	n = read(_pty, _out, sizeof(_out));
+	_out_len = (n > 0) ? n : 0;
+	_out_pos = 0;
+	return _out_len > 0;
+}
+
+uint16_t Endpoint_BytesInEndpoint(void) {
+	return _out_len - _out_pos;
+}
+
+uint8_t Endpoint_Read_8(void) {
+	return (_out_pos < _out_len) ? _out[_out_pos++] : 0;
+}
+
+void Endpoint_ClearOUT(void) {
+	_out_len = _out_pos = 0;
+}
+
+void CDC_Device_ProcessControlRequest(USB_ClassInfo_CDC_Device_t * info) {
+	(void)info;
+}
+
+/* Host "otworzył port" od razu po konfiguracji */
+bool CDC_Device_ConfigureEndpoints(USB_ClassInfo_CDC_Device_t * info) {
+	_cdc = info;
+	_cdc->State.LineEncoding.BaudRateBPS = 9600;
+	return 1;
+}
+
+/* Niepełny pakiet IN wysyłany na koniec przebiegu pętli */
+void CDC_Device_USBTask(USB_ClassInfo_CDC_Device_t * info) {
+	(void)info;
+
+	if (_in_len)
+		Endpoint_ClearIN();
+}
+
+static void usage(const char * name) {
+	fprintf(stderr, "Uzycie: %s [-r obroty] [-w] [-f plik] [-l dowiazanie]\n", name);
+	fprintf(stderr, "  -r  obroty walu (domyslnie %d)\n", EMU_RPM_IDLE);
+	fprintf(stderr, "  -w  obroty od %d do zadanych i z powrotem co %.0f s\n", EMU_RPM_IDLE, EMU_SWEEP_PERIOD);
+	fprintf(stderr, "  -f  plik z zawartoscia eeprom (wczytywany, zapisywany przy wyjsciu)\n");
+	fprintf(stderr, "  -l  dowiazanie symboliczne do pseudoterminala (np. /tmp/ttyECU)\n");
+}
+
+int main(int argc, char * argv[]) {
+	struct sigaction sa;
+	int opt;
+
+	while((opt = getopt(argc, argv, "r:wf:l:h")) != -1) {
+		switch(opt) {
+			case 'r': {
+				_rpm = atof(optarg);
+				break;
+			}
+			case 'w': {
+				_sweep = 1;
+				break;
+			}
+			case 'f': {
+				_eeprom_file = optarg;
+				break;
+			}
+			case 'l': {
+				_link = optarg;
+				break;
+			}
+			default: {
+				usage(argv[0]);
+				return 1;
+			}
+		}
+	}
+
+	if (emu_open_pty())
+		return 1;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = emu_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	emu_load_eeprom();
+
+	return ecu_main();
+}
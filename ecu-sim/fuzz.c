@@ -0,0 +1,387 @@
+/*
+ * Test parsera poleceń interfejsu (src/parser.c) na hoście.
+ *
+ * 1. Poprawne polecenia z losowymi argumentami - wynik dekodowania
+ *    porównywany jest z wartościami, z których polecenie zbudowano.
+ * 2. Losowe bajty (głównie znaki poleceń, cyfry hex, separatory i '\r') -
+ *    parser nie może wyjść poza tablice (najlepiej z SIM_FLAGS=-fsanitize=...).
+ * 3. Czas dekodowania polecenia 'w' (pełna mapa) w porównaniu z poprzednią
+ *    metodą (bufor na całą linię, memset po każdym poleceniu). Czas mierzony
+ *    jest na hoście, nadaje się tylko do porównania metod między sobą.
+ *
+ * Użycie: ecu-fuzz [-n ilość] [-r ziarno]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <util/crc16.h>
+#include "parser.h"
+#include "map.h"
+#include "immo.h"
+#include "params.h"
+
+#define FUZZ_BUFSZ          1024
+#define FUZZ_BENCH_COMMANDS 20000L
+#define OLD_DATA_BUFSZ      (2 + MAP_ROWS * (MAP_RPM_SIZE * 2 + 1))
+
+static const char _hex[] = "0123456789abcdef";
+static const char _alphabet[] = "vdlegtsGSrwcxyki0123456789abcdefABCDEF;;# \r\r\n\x00\xff";
+
+static struct parser _parser;
+static unsigned long _errors;
+
+static inline double fuzz_now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Podanie całego polecenia, zwraca 1 gdy parser zgłosił koniec polecenia na ostatnim znaku */
+static int fuzz_feed(const char * data, int datasz) {
+	int i, done = 0;
+
+	for(i = 0; i < datasz; i++) {
+		done = parser_feed(&_parser, data[i]);
+		if ((done) && (i < datasz - 1)) {
+			fprintf(stderr, "Polecenie zakonczone przed koncem (znak %d)\n", i);
+			_errors++;
+			parser_reset(&_parser);
+		}
+	}
+
+	return done;
+}
+
+static int fuzz_put_hex(char * buf, unsigned int value, int digits) {
+	int i;
+
+	for(i = 0; i < digits; i++)
+		buf[i] = _hex[(value >> (4 * (digits - 1 - i))) & 0x0F];
+
+	return digits;
+}
+
+static void fuzz_check(int ok, const char * what, const char * cmd) {
+	if (!ok) {
+		fprintf(stderr, "Blad dekodowania (%s): %s\n", what, cmd);
+		_errors++;
+	}
+}
+
+/* Poprawne polecenie z losowymi argumentami */
+static void fuzz_valid(void) {
+	uint8_t map[MAP_ROWS][MAP_RPM_SIZE];
+	uint16_t axes[MAP_RPM_SIZE + MAP_LOAD_SIZE];
+	uint16_t params[PARAM_COUNT];
+	uint8_t cells[PARSER_CELLS_MAX];
+	char keys[IMMO_KEYS][IMMO_KEY_LEN + 1];
+	char buf[FUZZ_BUFSZ];
+	int len = 0, i, j, id, value, count, crc = 0;
+	uint8_t cmd;
+
+	cmd = "vdlegtsGSrwcxyki"[rand() % 16];
+	buf[len++] = cmd;
+
+	id = rand() & 0xFF;
+	value = rand() & 0xFFFF;
+	count = 1 + rand() % PARAM_COUNT;
+
+	switch(cmd) {
+		case 'e':
+		case 'g':
+		case 't': {
+			len += fuzz_put_hex(&buf[len], id, 2);
+			break;
+		}
+		case 'l':
+		case 'G': {
+			len += fuzz_put_hex(&buf[len], value, 4);
+			break;
+		}
+		case 's': {
+			len += fuzz_put_hex(&buf[len], id, 2);
+			len += fuzz_put_hex(&buf[len], value, 4);
+			break;
+		}
+		case 'S': {
+			len += fuzz_put_hex(&buf[len], id, 2);
+			for(i = 0; i < count; i++) {
+				params[i] = rand();
+				len += fuzz_put_hex(&buf[len], params[i], 4);
+			}
+			break;
+		}
+		case 'c': {
+			count = 1 + rand() % PARSER_CELLS_MAX;
+			len += fuzz_put_hex(&buf[len], id % MAP_ROWS, 2);
+			len += fuzz_put_hex(&buf[len], value % MAP_RPM_SIZE, 2);
+			for(i = 0; i < count; i++) {
+				cells[i] = rand();
+				len += fuzz_put_hex(&buf[len], cells[i], 2);
+			}
+			break;
+		}
+		case 'w': {
+			for(i = 0; i < MAP_ROWS; i++) {
+				for(j = 0; j < MAP_RPM_SIZE; j++) {
+					map[i][j] = rand();
+					len += fuzz_put_hex(&buf[len], map[i][j], 2);
+				}
+				buf[len++] = ';';
+			}
+			crc = 0xFFFF;
+			for(i = 0; i < MAP_ROWS * MAP_RPM_SIZE; i++)
+				crc = _crc_ccitt_update(crc, ((uint8_t *)map)[i]);
+			if (id & 1) { /* Z CRC albo bez (starsza wersja diag-app) */
+				buf[len++] = '#';
+				len += fuzz_put_hex(&buf[len], crc, 4);
+			}
+			break;
+		}
+		case 'y': {
+			for(i = 0; i < MAP_RPM_SIZE + MAP_LOAD_SIZE; i++) {
+				axes[i] = rand();
+				len += fuzz_put_hex(&buf[len], axes[i], 4);
+			}
+			break;
+		}
+		case 'i': {
+			for(i = 0; i < IMMO_KEYS; i++) {
+				for(j = 0; j < IMMO_KEY_LEN; j++)
+					keys[i][j] = _hex[rand() & 0x0F];
+				keys[i][j] = '\0';
+				len += sprintf(&buf[len], "%s ", keys[i]);
+			}
+			break;
+		}
+	}
+
+	buf[len++] = '\r';
+	buf[len] = '\0';
+
+	fuzz_check(fuzz_feed(buf, len), "brak konca", buf);
+	fuzz_check((_parser.cmd == cmd) && (!_parser.error), "polecenie", buf);
+
+	switch(cmd) {
+		case 'e':
+		case 'g':
+		case 't': {
+			fuzz_check((_parser.digits == 2) && (_parser.value == id), "argument", buf);
+			break;
+		}
+		case 'l':
+		case 'G': {
+			fuzz_check((_parser.digits == 4) && (_parser.value == value), "argument", buf);
+			break;
+		}
+		case 's': {
+			fuzz_check((_parser.row == id) && (_parser.value == value), "parametr", buf);
+			break;
+		}
+		case 'S': {
+			fuzz_check((_parser.row == id) && (_parser.digits == 2 + 4 * count) &&
+			           (!memcmp(params, _parser.args.params, count * sizeof(uint16_t))), "parametry", buf);
+			break;
+		}
+		case 'c': {
+			fuzz_check((_parser.row == id % MAP_ROWS) && (_parser.col == value % MAP_RPM_SIZE) && (_parser.digits == 4 + 2 * count) &&
+			           (!memcmp(cells, _parser.args.cells, count)), "komorki", buf);
+			break;
+		}
+		case 'w': {
+			fuzz_check(!memcmp(map, __map_staging, sizeof(map)), "mapa", buf);
+			fuzz_check(map_staging_crc() == crc, "crc mapy", buf);
+			if (id & 1)
+				fuzz_check((_parser.row == PARSER_MAP_CRC) && (_parser.digits == 4) && (_parser.value == crc), "crc", buf);
+			break;
+		}
+		case 'y': {
+			fuzz_check((_parser.digits == PARSER_AXES_DIGITS) && (!memcmp(axes, _parser.args.axes, sizeof(axes))), "osie", buf);
+			break;
+		}
+		case 'i': {
+			for(i = 0; i < IMMO_KEYS; i++)
+				fuzz_check(!strcmp(keys[i], (char *)_parser.args.keys[i]), "klucze", buf);
+			break;
+		}
+	}
+
+	parser_reset(&_parser);
+}
+
+/* Polecenie 's' bez pełnych 2 + 4 cyfr (lub z nadmiarem) musi skończyć się błędem 0x01 */
+static void fuzz_short(void) {
+	static const char * const cmds[] = { "s\r", "s07\r", "s0712\r", "s07123\r", "s0712345\r" };
+	unsigned int i;
+
+	for(i = 0; i < sizeof(cmds) / sizeof(cmds[0]); i++) {
+		fuzz_check(fuzz_feed(cmds[i], strlen(cmds[i])), "brak konca", cmds[i]);
+		fuzz_check(_parser.error == 0x01, "niepelne 's'", cmds[i]);
+		parser_reset(&_parser);
+	}
+}
+
+/* Losowe bajty - sprawdzamy tylko, czy stan parsera jest spójny */
+static unsigned long fuzz_random(long bytes) {
+	unsigned long commands = 0;
+	long i;
+	uint8_t c;
+
+	for(i = 0; i < bytes; i++) {
+		c = (rand() & 7) ? _alphabet[rand() % (sizeof(_alphabet) - 1)] : rand();
+
+		if (parser_feed(&_parser, c)) {
+			commands++;
+			parser_reset(&_parser);
+		}
+
+		if (((_parser.cmd == 'w') && (_parser.row != PARSER_MAP_CRC) && ((_parser.row > MAP_ROWS + 1) || (_parser.col > MAP_RPM_SIZE))) ||
+		    ((_parser.cmd == 'w') && (_parser.row == PARSER_MAP_CRC) && (_parser.digits > 4)) ||
+		    ((_parser.cmd == 'i') && ((_parser.row > IMMO_KEYS) || (_parser.col > IMMO_KEY_LEN))) ||
+		    ((_parser.cmd == 'y') && (_parser.digits > PARSER_AXES_DIGITS)) ||
+		    ((_parser.cmd == 'S') && (_parser.digits > PARSER_PARAMS_DIGITS)) ||
+		    ((_parser.cmd == 'c') && (_parser.digits > PARSER_CELLS_DIGITS))) {
+			fprintf(stderr, "Niespojny stan parsera: '%c' wiersz %u kolumna %u cyfry %u\n", _parser.cmd, _parser.row,
+			        _parser.col, _parser.digits);
+			_errors++;
+		}
+	}
+
+	return commands;
+}
+
+/* Poprzednia metoda - bufor na całą linię, dekodowanie po '\r', memset bufora */
+static uint8_t old_hex2int8(uint8_t * data) {
+	uint8_t res = 0;
+
+	if ((data[0] >= '0') && (data[0] <= '9'))
+		res = (data[0] - '0') << 4;
+	else if (((data[0] | 0x20) >= 'a') && ((data[0] | 0x20) <= 'f'))
+		res = ((data[0] | 0x20) - 'a' + 10) << 4;
+
+	if ((data[1] >= '0') && (data[1] <= '9'))
+		res |= data[1] - '0';
+	else if (((data[1] | 0x20) >= 'a') && ((data[1] | 0x20) <= 'f'))
+		res |= (data[1] | 0x20) - 'a' + 10;
+
+	return res;
+}
+
+static void old_recv_byte(uint8_t data) {
+	static uint16_t bufidx;
+	static uint8_t buf[OLD_DATA_BUFSZ];
+	int i, row, col;
+
+	if (data == '\n')
+		return;
+
+	if (data == '\r') {
+		if ((bufidx > 0) && (buf[0] == 'w')) {
+			row = col = 0;
+			for(i = 1; i < bufidx; i++) {
+				if (buf[i] == ';') {
+					row++;
+					col = 0;
+				}
+				else {
+					if ((row >= MAP_ROWS) || (col >= MAP_RPM_SIZE))
+						break;
+					__map_staging[row / MAP_LOAD_SIZE][row % MAP_LOAD_SIZE][col++] = old_hex2int8(&buf[i++]);
+				}
+			}
+		}
+
+		bufidx = 0;
+		memset(buf, 0x00, OLD_DATA_BUFSZ);
+	}
+	else if (bufidx < OLD_DATA_BUFSZ) {
+		buf[bufidx++] = data;
+	}
+}
+
+static void fuzz_bench(void) {
+	char buf[FUZZ_BUFSZ];
+	int len = 0, i, j;
+	double t0, t_old, t_new;
+	long n;
+
+	buf[len++] = 'w';
+	for(i = 0; i < MAP_ROWS; i++) {
+		for(j = 0; j < MAP_RPM_SIZE; j++)
+			len += fuzz_put_hex(&buf[len], rand() & 0xFF, 2);
+		buf[len++] = ';';
+	}
+	buf[len++] = '\r';
+
+	t0 = fuzz_now_ns();
+	for(n = 0; n < FUZZ_BENCH_COMMANDS; n++) {
+		for(i = 0; i < len; i++)
+			old_recv_byte(buf[i]);
+	}
+	t_old = (fuzz_now_ns() - t0) / ((double)FUZZ_BENCH_COMMANDS * len);
+
+	t0 = fuzz_now_ns();
+	for(n = 0; n < FUZZ_BENCH_COMMANDS; n++) {
+		for(i = 0; i < len; i++) {
+			if (parser_feed(&_parser, buf[i]))
+				parser_reset(&_parser);
+		}
+	}
+	t_new = (fuzz_now_ns() - t0) / ((double)FUZZ_BENCH_COMMANDS * len);
+
+	printf("bench 'w' (%d B): bufor+memset %.2f ns/B (%u B RAM), parser %.2f ns/B (%u B RAM)\n", len,
+	       t_old, (unsigned int)OLD_DATA_BUFSZ, t_new, (unsigned int)sizeof(struct parser));
+}
+
+static void usage(const char * name) {
+	fprintf(stderr, "Uzycie: %s [-n ilosc] [-r ziarno]\n", name);
+	fprintf(stderr, "  -n  ilosc poprawnych polecen (losowych bajtow x 100)\n");
+	fprintf(stderr, "  -r  ziarno generatora liczb losowych\n");
+}
+
+int main(int argc, char * argv[]) {
+	long count = 100000, i;
+	unsigned int seed = 1;
+	unsigned long commands;
+	int opt;
+
+	while((opt = getopt(argc, argv, "n:r:h")) != -1) {
+		switch(opt) {
+			case 'n': {
+				count = atol(optarg);
+				break;
+			}
+			case 'r': {
+				seed = atoi(optarg);
+				break;
+			}
+			default: {
+				usage(argv[0]);
+				return 1;
+			}
+		}
+	}
+
+	srand(seed);
+	params_init();
+	map_init();
+	parser_reset(&_parser);
+
+	for(i = 0; i < count; i++)
+		fuzz_valid();
+	printf("valid: %ld polecen, %lu bledow\n", count, _errors);
+	fuzz_short();
+	printf("short: %lu bledow\n", _errors);
+
+	commands = fuzz_random(count * 100);
+	parser_reset(&_parser);
+	printf("random: %ld bajtow, %lu polecen, %lu bledow\n", count * 100, commands, _errors);
+
+	fuzz_bench();
+
+	return _errors ? 1 : 0;
+}
@@ -0,0 +1,80 @@
+#ifndef __SIM_LUFA_USB_H
+#define __SIM_LUFA_USB_H
+
+/*
+ * Emulowany LUFA (urządzenie CDC) - tylko to, czego używa src/interface.c.
+ * Endpointy IN / OUT to bufory po CDC_TXRX_EPSIZE bajtów przepisywane do / z
+ * pseudoterminala przez emulator (emu.c), który implementuje też funkcje
+ * poniżej. Urządzenie jest zawsze skonfigurowane i podłączone.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ATTR_WARN_UNUSED_RESULT
+#define ATTR_NON_NULL_PTR_ARG(...)
+
+#define ENDPOINT_DIR_IN                 0x80
+#define ENDPOINT_DIR_OUT                0x00
+
+#define DEVICE_STATE_Unattached         0
+#define DEVICE_STATE_Configured         4
+
+#define ENDPOINT_READYWAIT_NoError      0
+#define ENDPOINT_READYWAIT_Timeout      3
+
+/* Deskryptory nie są używane przez emulator, wystarczą typy */
+typedef struct { uint8_t bLength; } USB_Descriptor_Configuration_Header_t;
+typedef struct { uint8_t bLength; } USB_Descriptor_Interface_t;
+typedef struct { uint8_t bLength; } USB_Descriptor_Endpoint_t;
+typedef struct { uint8_t bLength; } USB_CDC_Descriptor_FunctionalHeader_t;
+typedef struct { uint8_t bLength; } USB_CDC_Descriptor_FunctionalACM_t;
+typedef struct { uint8_t bLength; } USB_CDC_Descriptor_FunctionalUnion_t;
+
+typedef struct {
+	uint8_t Address;
+	uint16_t Size;
+	uint8_t Banks;
+} USB_Endpoint_Table_t;
+
+typedef struct {
+	struct {
+		uint8_t ControlInterfaceNumber;
+		USB_Endpoint_Table_t DataINEndpoint;
+		USB_Endpoint_Table_t DataOUTEndpoint;
+		USB_Endpoint_Table_t NotificationEndpoint;
+	} Config;
+	struct {
+		struct {
+			uint32_t BaudRateBPS;
+		} LineEncoding;
+	} State;
+} USB_ClassInfo_CDC_Device_t;
+
+extern volatile uint8_t USB_DeviceState;
+
+void USB_Init(void);
+void USB_USBTask(void);
+uint16_t USB_Device_GetFrameNumber(void);
+
+void Endpoint_SelectEndpoint(uint8_t address);
+bool Endpoint_IsReadWriteAllowed(void);
+void Endpoint_ClearIN(void);
+uint8_t Endpoint_WaitUntilReady(void);
+void Endpoint_Write_8(uint8_t data);
+bool Endpoint_IsOUTReceived(void);
+uint16_t Endpoint_BytesInEndpoint(void);
+uint8_t Endpoint_Read_8(void);
+void Endpoint_ClearOUT(void);
+
+void CDC_Device_ProcessControlRequest(USB_ClassInfo_CDC_Device_t * info);
+bool CDC_Device_ConfigureEndpoints(USB_ClassInfo_CDC_Device_t * info);
+void CDC_Device_USBTask(USB_ClassInfo_CDC_Device_t * info);
+
+/* Zdarzenia implementowane przez interface.c */
+void EVENT_USB_Device_Connect(void);
+void EVENT_USB_Device_Disconnect(void);
+void EVENT_USB_Device_ConfigurationChanged(void);
+void EVENT_USB_Device_ControlRequest(void);
+
+#endif /* __SIM_LUFA_USB_H */
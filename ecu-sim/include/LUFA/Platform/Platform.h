@@ -0,0 +1,6 @@
+#ifndef __SIM_LUFA_PLATFORM_H
+#define __SIM_LUFA_PLATFORM_H
+
+/* Emulowany LUFA nie potrzebuje niczego zależnego od platformy (patrz USB/USB.h) */
+
+#endif /* __SIM_LUFA_PLATFORM_H */
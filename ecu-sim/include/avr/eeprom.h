@@ -0,0 +1,32 @@
+#ifndef __SIM_AVR_EEPROM_H
+#define __SIM_AVR_EEPROM_H
+
+/*
+ * EEPROM emulowany tablicą w RAM hosta (eeprom.c), adresy jak w atmega32u4.
+ * Każdy zapis bajtu jest liczony osobno dla każdej komórki (zużycie).
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <avr/io.h>
+
+#define EEMEM
+
+extern uint8_t __sim_eeprom[E2END + 1];
+extern uint32_t __sim_eeprom_writes[E2END + 1];
+
+#define eeprom_busy_wait()
+
+uint8_t eeprom_read_byte(const uint8_t * addr);
+uint16_t eeprom_read_word(const uint16_t * addr);
+void eeprom_read_block(void * dst, const void * src, size_t n);
+void eeprom_write_byte(uint8_t * addr, uint8_t value);
+void eeprom_update_block(const void * src, void * dst, size_t n);
+
+/* Rozszerzenia symulatora */
+void sim_eeprom_erase(void);
+void sim_eeprom_flush(void);
+void sim_eeprom_cut(long writes);
+unsigned long sim_eeprom_total_writes(void);
+
+#endif /* __SIM_AVR_EEPROM_H */
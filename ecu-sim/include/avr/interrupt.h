@@ -0,0 +1,22 @@
+#ifndef __SIM_AVR_INTERRUPT_H
+#define __SIM_AVR_INTERRUPT_H
+
+#include <stdint.h>
+
+/* Procedury obsługi przerwań są zwykłymi funkcjami wołanymi przez symulator */
+#define ISR(vector) void vector(void)
+
+extern volatile uint8_t __sim_sreg_i;
+
+#define sei()   (__sim_sreg_i = 1)
+#define cli()   (__sim_sreg_i = 0)
+
+ISR(INT0_vect);
+ISR(INT1_vect);
+ISR(TIMER1_OVF_vect);
+ISR(TIMER1_COMPA_vect);
+ISR(TIMER1_COMPB_vect);
+ISR(ADC_vect);
+ISR(EE_READY_vect);
+
+#endif /* __SIM_AVR_INTERRUPT_H */
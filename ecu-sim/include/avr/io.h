@@ -0,0 +1,110 @@
+#ifndef __SIM_AVR_IO_H
+#define __SIM_AVR_IO_H
+
+/* Emulowane rejestry atmega32u4 - tylko te, których używa firmware (definicje w regs.c) */
+
+#include <stdint.h>
+
+extern volatile uint8_t DDRB, PORTB, PINB;
+extern volatile uint8_t DDRC, PORTC, PINC;
+extern volatile uint8_t DDRD, PORTD, PIND;
+extern volatile uint8_t DDRE, PORTE, PINE;
+extern volatile uint8_t DDRF, PORTF, PINF;
+
+extern volatile uint8_t EICRA, EIMSK, EIFR;
+extern volatile uint8_t DIDR2;
+extern volatile uint8_t MCUSR;
+
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+extern volatile uint16_t TCNT1, OCR1A, OCR1B;
+extern volatile uint8_t TCCR3A, TCCR3B, TIMSK3, TIFR3;
+extern volatile uint16_t TCNT3;
+
+extern volatile uint8_t ADMUX, ADCSRA, ADCSRB;
+extern volatile uint16_t ADC;
+
+extern volatile uint8_t UCSR1A, UCSR1B, UCSR1C, UBRR1H, UBRR1L, UDR1;
+
+extern volatile uint8_t EECR;
+
+/* Bity portów */
+#define PB0     0
+#define PB1     1
+#define PB2     2
+#define PB3     3
+#define PB4     4
+#define PB5     5
+#define PB6     6
+#define PB7     7
+#define PC6     6
+#define PC7     7
+#define PD0     0
+#define PD1     1
+#define PD2     2
+#define PD3     3
+#define PD4     4
+#define PD5     5
+#define PD6     6
+#define PD7     7
+#define PE6     6
+#define PF0     0
+#define PF1     1
+#define PF4     4
+#define PF5     5
+#define PF6     6
+#define PF7     7
+
+/* Przerwania zewnętrzne */
+#define ISC00   0
+#define ISC01   1
+#define ISC10   2
+#define ISC11   3
+#define INT0    0
+#define INT1    1
+
+/* Timery */
+#define CS10    0
+#define CS11    1
+#define CS12    2
+#define TOIE1   0
+#define OCIE1A  1
+#define OCIE1B  2
+#define TOV1    0
+#define OCF1A   1
+#define OCF1B   2
+#define CS30    0
+#define CS31    1
+#define CS32    2
+#define TOIE3   0
+#define TOV3    0
+
+/* ADC */
+#define ADC8D   0
+#define ADC9D   1
+#define MUX0    0
+#define MUX5    5
+#define REFS0   6
+#define REFS1   7
+#define ADPS0   0
+#define ADPS1   1
+#define ADPS2   2
+#define ADIE    3
+#define ADIF    4
+#define ADATE   5
+#define ADSC    6
+#define ADEN    7
+#define ADHSM   7
+
+/* USART1 */
+#define RXCIE1  7
+#define RXEN1   4
+#define TXEN1   3
+#define UCSZ10  1
+
+#define WDRF    3
+
+/* EEPROM */
+#define EERIE   3
+#define E2END   0x3FF
+
+#endif /* __SIM_AVR_IO_H */
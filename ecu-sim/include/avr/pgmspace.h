@@ -0,0 +1,8 @@
+#ifndef __SIM_AVR_PGMSPACE_H
+#define __SIM_AVR_PGMSPACE_H
+
+/* Pamięć programu na hoście to zwykła pamięć */
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+
+#endif /* __SIM_AVR_PGMSPACE_H */
@@ -0,0 +1,8 @@
+#ifndef __SIM_AVR_POWER_H
+#define __SIM_AVR_POWER_H
+
+#define clock_div_1 0
+
+#define clock_prescale_set(x) ((void)(x))
+
+#endif /* __SIM_AVR_POWER_H */
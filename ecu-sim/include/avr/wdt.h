@@ -0,0 +1,6 @@
+#ifndef __SIM_AVR_WDT_H
+#define __SIM_AVR_WDT_H
+
+#define wdt_disable()
+
+#endif /* __SIM_AVR_WDT_H */
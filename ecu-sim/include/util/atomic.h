@@ -0,0 +1,9 @@
+#ifndef __SIM_UTIL_ATOMIC_H
+#define __SIM_UTIL_ATOMIC_H
+
+/* Symulator wywołuje przerwania synchronicznie, więc blok atomowy jest zwykłym blokiem */
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+#define ATOMIC_BLOCK(type) for(int __sim_atomic = 1; __sim_atomic; __sim_atomic = 0)
+
+#endif /* __SIM_UTIL_ATOMIC_H */
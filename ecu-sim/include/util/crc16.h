@@ -0,0 +1,14 @@
+#ifndef __SIM_UTIL_CRC16_H
+#define __SIM_UTIL_CRC16_H
+
+#include <stdint.h>
+
+/* CRC16-CCITT (wielomian 0x1021, odwrócony), jak _crc_ccitt_update() z avr-libc */
+static inline uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data) {
+	data ^= crc & 0xFF;
+	data ^= data << 4;
+
+	return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^ ((uint16_t)data << 3));
+}
+
+#endif /* __SIM_UTIL_CRC16_H */
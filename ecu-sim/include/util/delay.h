@@ -0,0 +1,7 @@
+#ifndef __SIM_UTIL_DELAY_H
+#define __SIM_UTIL_DELAY_H
+
+#define _delay_ms(x) ((void)(x))
+#define _delay_us(x) ((void)(x))
+
+#endif /* __SIM_UTIL_DELAY_H */
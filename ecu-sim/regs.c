@@ -0,0 +1,26 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+volatile uint8_t DDRB, PORTB, PINB;
+volatile uint8_t DDRC, PORTC, PINC;
+volatile uint8_t DDRD, PORTD, PIND;
+volatile uint8_t DDRE, PORTE, PINE;
+volatile uint8_t DDRF, PORTF, PINF;
+
+volatile uint8_t EICRA, EIMSK, EIFR;
+volatile uint8_t DIDR2;
+volatile uint8_t MCUSR;
+
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+volatile uint16_t TCNT1, OCR1A, OCR1B;
+volatile uint8_t TCCR3A, TCCR3B, TIMSK3, TIFR3;
+volatile uint16_t TCNT3;
+
+volatile uint8_t ADMUX, ADCSRA, ADCSRB;
+volatile uint16_t ADC;
+
+volatile uint8_t UCSR1A, UCSR1B, UCSR1C, UBRR1H, UBRR1L, UDR1;
+
+volatile uint8_t EECR;
+
+volatile uint8_t __sim_sreg_i;
@@ -0,0 +1,591 @@
+/*
+ * Symulator zapłonu ECU na hosta (Linux).
+ *
+ * Kompiluje prawdziwe procedury przerwań z src/main.c razem z emulowanymi
+ * rejestrami (include/avr/io.h, regs.c) i napędza je syntetycznym przebiegiem
+ * obrotów wału. Czas płynie w tyknięciach timera (F_CPU / 64), TCNT1 jest
+ * zwiększany co tyknięcie, przepełnienie wywołuje TIMER1_OVF_vect, zrównanie
+ * z OCR1A / OCR1B TIMER1_COMPA_vect / TIMER1_COMPB_vect, a czujniki GMP / DMP
+ * wywołują INT1_vect / INT0_vect.
+ * Przetwornik ADC zwraca stałe wartości i wywołuje ADC_vect po konwersji.
+ * Iskra to moment wyłączenia cewki (zbocze opadające PB3), czas ładowania
+ * cewki (od zbocza narastającego) wypisywany jest jako dwell_min / dwell_max.
+ * W strefie pomijania iskier ogranicznika obrotów brak iskry nie jest błędem,
+ * kolumna skipped to ilość pominiętych tam iskier.
+ *
+ * Dla każdego scenariusza wypisywany jest błąd kąta iskry względem mapy
+ * (dla rzeczywistych obrotów w chwili iskry) oraz błąd zmierzony przez sam
+ * firmware (timing.c, względem wyprzedzenia zadanego dla iskry - bez błędu
+ * przewidywania obrotów z poprzedniego obrotu). Dodatkowo mierzony jest czas
+ * wykonania przerwań czujnika wału przy stałych obrotach (INT1 + INT0
+ * wywoływane na przemian milion razy). Czas mierzony jest na hoście (ns),
+ * więc nadaje się tylko do porównywania wersji kodu między sobą.
+ *
+ * Opcja -e włącza dziennik zdarzeń firmware (eventlog.c) i zapisuje jego
+ * wpisy do pliku CSV - kolejka opróżniana jest w każdym GMP, tak jak robi to
+ * pętla główna.
+ *
+ * Użycie: ecu-sim [-s scenariusz] [-c plik.csv] [-e plik.csv] [-p nr=wartość] [-l]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include "map.h"
+#include "params.h"
+#include "eventlog.h"
+#include "timing.h"
+
+#define SIM_TICKS_PER_SEC   (F_CPU / 64UL)
+#define SIM_COIL_BIT        (1 << PB3)
+#define SIM_MAX_POINTS      8
+#define SIM_ADC_TICKS       13  /* Czas konwersji ADC (13 taktów zegara ADC, prescaler 64) */
+#define SIM_ADC_TEMP        500 /* Stałe odczyty czujników analogowych */
+#define SIM_ADC_THROTTLE    300
+#define SIM_BENCH_CALLS     1000000L
+#define SIM_EXIT_MISSED     2   /* Kod wyjścia przebiegu, w którym wypadła iskra */
+#define SIM_BENCH_RPMS      (sizeof(_bench_rpms) / sizeof(_bench_rpms[0]))
+
+void init(void);
+
+/* Scenariusz - obroty zadane jako łamana (czas [s], obroty) */
+struct sim_point {
+	double t;
+	double rpm;
+};
+
+struct sim_scenario {
+	const char * name;
+	double duration;
+	struct sim_point points[SIM_MAX_POINTS];
+};
+
+static const struct sim_scenario _scenarios[] = {
+	{ "steady-1500",  2.0, { { 0.0, 1500 }, { 2.0, 1500 }, { -1, 0 } } },
+	{ "steady-4000",  2.0, { { 0.0, 4000 }, { 2.0, 4000 }, { -1, 0 } } },
+	{ "steady-7000",  2.0, { { 0.0, 7000 }, { 2.0, 7000 }, { -1, 0 } } },
+	{ "accel",        2.0, { { 0.0, 1500 }, { 0.5, 1500 }, { 1.2, 7500 }, { 2.0, 7500 }, { -1, 0 } } },
+	{ "decel",        2.5, { { 0.0, 7500 }, { 0.5, 7500 }, { 2.0, 1500 }, { 2.5, 1500 }, { -1, 0 } } },
+	{ "accel-hard",   1.5, { { 0.0, 1500 }, { 0.5, 1500 }, { 0.8, 7500 }, { 1.5, 7500 }, { -1, 0 } } },
+	{ "blip",         2.0, { { 0.0, 2000 }, { 0.5, 2000 }, { 0.7, 6000 }, { 1.2, 2000 }, { 2.0, 2000 }, { -1, 0 } } },
+	{ "stall",        3.0, { { 0.0, 3000 }, { 0.5, 3000 }, { 0.9, 0 }, { 3.0, 0 }, { -1, 0 } } },
+	{ "limiter",      2.0, { { 0.0, 7000 }, { 0.3, 7000 }, { 1.2, 8200 }, { 2.0, 8200 }, { -1, 0 } } },
+	{ "restart",      4.0, { { 0.0, 0 }, { 0.5, 0 }, { 0.6, 250 }, { 1.5, 250 }, { 2.0, 1500 }, { 4.0, 1500 }, { -1, 0 } } },
+};
+
+#define SIM_SCENARIOS (sizeof(_scenarios) / sizeof(_scenarios[0]))
+
+/* Obroty, przy których mierzony jest czas przerwań */
+static const unsigned int _bench_rpms[] = { 1500, 4000, 7000 };
+
+/* Mapa testowa (wszystkie wiersze obciążenia takie same) - wyprzedzenie rośnie z obrotami po 1-2 stopnie */
+static const uint8_t _test_map[MAP_RPM_SIZE] = {
+	8, 10, 12, 14, 16, 18, 20, 22, 24, 25, 26, 27, 28, 28, 28, 28
+};
+
+static uint16_t _test_params[PARAM_COUNT] = {
+	[PARAM_IGN_CUT_OFF_START] = 7800,
+	[PARAM_IGN_CUT_OFF_END]   = 7600,
+	[PARAM_DYNAMIC_ON]        = 1000,
+	[PARAM_DYNAMIC_OFF]       = 800,
+	[PARAM_CURRENT_MAP]       = 0,
+	[PARAM_IMMO_ENABLED]      = 0,
+	[PARAM_CRANK_OFFSET]      = 6,
+	[PARAM_DWELL_TIME]        = 3000,
+	[PARAM_LIMIT_WINDOW]      = 200,
+};
+
+/* Wyniki pojedynczego scenariusza */
+struct sim_stats {
+	unsigned long edges;
+	unsigned long sparks;
+	unsigned long missed;
+	unsigned long unexpected;
+	unsigned long skipped;
+	unsigned long measured;
+	double err_sum;
+	double err_sq_sum;
+	double err_max;
+	unsigned long dwell_min; /* Czas ładowania cewki [tyknięcia] */
+	unsigned long dwell_max;
+};
+
+static FILE * _csv;
+static FILE * _events;
+static int _list_only;
+static int _missed_fail; /* Któryś przebieg zgubił iskrę - kod wyjścia 1 */
+
+static double sim_profile_rpm(const struct sim_scenario * s, double t) {
+	int i;
+
+	for(i = 1; (i < SIM_MAX_POINTS) && (s->points[i].t >= 0); i++) {
+		if (t <= s->points[i].t) {
+			double a = (t - s->points[i - 1].t) / (s->points[i].t - s->points[i - 1].t);
+			return s->points[i - 1].rpm + a * (s->points[i].rpm - s->points[i - 1].rpm);
+		}
+	}
+
+	return s->points[i - 1].rpm;
+}
+
+static inline double sim_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+/* Wartość komórki mapy testowej, tak jak realizuje ją firmware (nie mniej niż offset czujnika) */
+static double sim_map_cell(int i) {
+	if (_test_map[i] <= _test_params[PARAM_CRANK_OFFSET])
+		return _test_params[PARAM_CRANK_OFFSET];
+	return _test_map[i];
+}
+
+/*
+ * Współczynnik wyprzedzenia ogranicznika obrotów (1 - bez zmian, 0 - iskra
+ * w GMP). Firmware interpoluje liniowo po czasie 1/2 obrotu, czyli po 1/obroty.
+ */
+static double sim_limit_factor(double rpm) {
+	double start = _test_params[PARAM_IGN_CUT_OFF_START], soft = start - _test_params[PARAM_LIMIT_WINDOW];
+
+	if ((!_test_params[PARAM_LIMIT_WINDOW]) || (rpm <= soft))
+		return 1.0;
+	if (rpm >= start)
+		return 0.0;
+	return (1.0 / rpm - 1.0 / start) / (1.0 / soft - 1.0 / start);
+}
+
+/* Wyprzedzenie, które powinno zostać zrealizowane przy danych obrotach (interpolacja liniowa po osi obrotów) */
+static double sim_commanded_advance(double rpm, int dynamic) {
+	int i;
+	double a, cell;
+
+	if (!dynamic)
+		return _test_params[PARAM_CRANK_OFFSET];
+
+	if (rpm <= __map_rpm_axis[0]) {
+		cell = sim_map_cell(0);
+	}
+	else {
+		cell = sim_map_cell(MAP_RPM_SIZE - 1);
+		for(i = 0; i < MAP_RPM_SIZE - 1; i++) {
+			if (rpm < __map_rpm_axis[i + 1]) {
+				a = (rpm - __map_rpm_axis[i]) / (__map_rpm_axis[i + 1] - __map_rpm_axis[i]);
+				cell = sim_map_cell(i) + a * (sim_map_cell(i + 1) - sim_map_cell(i));
+				break;
+			}
+		}
+	}
+
+	return _test_params[PARAM_CRANK_OFFSET] + (cell - _test_params[PARAM_CRANK_OFFSET]) * sim_limit_factor(rpm);
+}
+
+static void sim_reset(void) {
+	int i, j;
+
+	DDRB = PORTB = 0;
+	TCNT1 = TCNT3 = OCR1A = OCR1B = 0;
+	TCCR1B = TCCR3B = 0;
+	TIMSK1 = TIMSK3 = 0;
+	EIMSK = 0;
+	ADCSRA = 0;
+
+	init();
+
+	memcpy(__params, _test_params, sizeof(__params));
+	params_save();
+
+	for(i = 0; i < MAP_COUNT; i++) {
+		for(j = 0; j < MAP_LOAD_SIZE; j++)
+			memcpy(__ignition_map[i][j], _test_map, MAP_RPM_SIZE);
+	}
+	map_write();
+	sim_eeprom_flush();
+
+	if (_events)
+		eventlog_enable(1);
+}
+
+/* Zapis wpisów dziennika zdarzeń firmware */
+static void sim_drain_events(const struct sim_scenario * s) {
+	struct eventlog_entry e;
+
+	while (eventlog_read(&e)) {
+		fprintf(_events, "%s,%u,%u,%u,%u,%d,%u,%u,%u,%u\n", s->name, e.revolution, e.tdc_time, e.bdc_time, e.half_time,
+		        e.acceleration, e.spark_time, e.coil_off_time, e.flags, eventlog_lost());
+	}
+}
+
+/* Stan bieżącego przebiegu */
+struct sim_state {
+	double theta;
+	double rpm;
+	uint8_t coil;
+	unsigned long coil_on;
+	int spark_in_cycle;
+	double spark_theta;
+	double spark_rpm;
+	int ref_dynamic;
+	int ref_cut;
+	int ref_skip; /* Strefa pomijania iskier ogranicznika obrotów */
+	int spark_dynamic;
+};
+
+/* Wykrycie iskry (wyłączenie cewki) po wykonaniu przerwania */
+static void sim_check_coil(struct sim_state * ss, struct sim_stats * st, unsigned long tick) {
+	if ((!ss->coil) && (PORTB & SIM_COIL_BIT))
+		ss->coil_on = tick;
+	
+	if (ss->coil && !(PORTB & SIM_COIL_BIT)) {
+		if ((!st->sparks) || (tick - ss->coil_on < st->dwell_min))
+			st->dwell_min = tick - ss->coil_on;
+		if (tick - ss->coil_on > st->dwell_max)
+			st->dwell_max = tick - ss->coil_on;
+		st->sparks++;
+		ss->spark_in_cycle++;
+		ss->spark_theta = ss->theta;
+		ss->spark_rpm = ss->rpm;
+		ss->spark_dynamic = ss->ref_dynamic;
+	}
+	ss->coil = PORTB & SIM_COIL_BIT;
+}
+
+/* Koniec obrotu (GMP) - ocena iskry z mijającego obrotu */
+static void sim_end_cycle(const struct sim_scenario * s, struct sim_state * ss, struct sim_stats * st, double t) {
+	double adv, err, d, cmd;
+
+	if (ss->spark_in_cycle) {
+		if (ss->ref_cut) {
+			st->unexpected++;
+		}
+		else {
+			/* Kąt iskry przed GMP (czujnik jest przesunięty o PARAM_CRANK_OFFSET przed GMP) */
+			d = fmod(ss->spark_theta, 360.0);
+			if (d < 180.0)
+				adv = _test_params[PARAM_CRANK_OFFSET] - d;
+			else
+				adv = _test_params[PARAM_CRANK_OFFSET] + 360.0 - d;
+
+			cmd = sim_commanded_advance(ss->spark_rpm, ss->spark_dynamic);
+			err = adv - cmd;
+
+			st->measured++;
+			st->err_sum += err;
+			st->err_sq_sum += err * err;
+			if (fabs(err) > st->err_max)
+				st->err_max = fabs(err);
+
+			if (_csv) {
+				fprintf(_csv, "%s,%.6f,%.0f,%.2f,%.2f,%.2f\n", s->name, t, ss->spark_rpm, cmd, adv, err);
+			}
+		}
+	}
+	else if (ss->ref_skip) {
+		st->skipped++;
+	}
+	else if ((!ss->ref_cut) && (ss->rpm > 0)) {
+		st->missed++;
+	}
+
+	ss->spark_in_cycle = 0;
+}
+
+static void sim_run(const struct sim_scenario * s, struct sim_stats * st) {
+	struct sim_state ss;
+	unsigned long tick, ticks;
+	long half, last_half = 0;
+	unsigned int adc_ticks = 0;
+	double t;
+
+	memset(st, 0, sizeof(*st));
+	memset(&ss, 0, sizeof(ss));
+	sim_reset();
+
+	ticks = (unsigned long)(s->duration * SIM_TICKS_PER_SEC);
+
+	for(tick = 0; tick < ticks; tick++) {
+		t = (double)tick / SIM_TICKS_PER_SEC;
+		ss.rpm = sim_profile_rpm(s, t);
+
+		/* Stan referencyjny (histereza jak w opisie parametrów) */
+		if (ss.rpm > _test_params[PARAM_DYNAMIC_ON])
+			ss.ref_dynamic = 1;
+		else if (ss.rpm < _test_params[PARAM_DYNAMIC_OFF])
+			ss.ref_dynamic = 0;
+
+		if (_test_params[PARAM_LIMIT_WINDOW]) {
+			ss.ref_cut = ss.rpm > _test_params[PARAM_IGN_CUT_OFF_START] + _test_params[PARAM_LIMIT_WINDOW];
+			ss.ref_skip = (!ss.ref_cut) && (ss.rpm > _test_params[PARAM_IGN_CUT_OFF_START]);
+		}
+		else if (ss.rpm > _test_params[PARAM_IGN_CUT_OFF_START])
+			ss.ref_cut = 1;
+		else if (ss.rpm < _test_params[PARAM_IGN_CUT_OFF_END])
+			ss.ref_cut = 0;
+
+		/* Timer */
+		if (TCCR1B & ((1 << CS10) | (1 << CS11) | (1 << CS12))) {
+			if ((++TCNT1 == 0) && (TIMSK1 & (1 << TOIE1))) {
+				TIMER1_OVF_vect();
+				sim_check_coil(&ss, st, tick);
+			}
+			if ((TCNT1 == OCR1A) && (TIMSK1 & (1 << OCIE1A))) {
+				TIMER1_COMPA_vect();
+				sim_check_coil(&ss, st, tick);
+			}
+			if ((TCNT1 == OCR1B) && (TIMSK1 & (1 << OCIE1B))) {
+				TIMER1_COMPB_vect();
+				sim_check_coil(&ss, st, tick);
+			}
+		}
+
+		/* ADC */
+		if ((ADCSRA & (1 << ADEN)) && (ADCSRA & (1 << ADSC)) && (++adc_ticks >= SIM_ADC_TICKS)) {
+			adc_ticks = 0;
+			ADC = (ADMUX & (1 << MUX0)) ? SIM_ADC_THROTTLE : SIM_ADC_TEMP;
+			ADCSRA &= ~(1 << ADSC);
+			if (ADCSRA & (1 << ADIE)) {
+				ADC_vect();
+				sim_check_coil(&ss, st, tick);
+			}
+		}
+
+		/* Wał */
+		ss.theta += ss.rpm * 6.0 / SIM_TICKS_PER_SEC;
+		half = (long)(ss.theta / 180.0);
+
+		if (half != last_half) {
+			last_half = half;
+			st->edges++;
+
+			if (half & 1) { /* DMP */
+				if (EIMSK & (1 << INT0)) {
+					INT0_vect();
+					sim_check_coil(&ss, st, tick);
+				}
+			}
+			else { /* GMP */
+				if (EIMSK & (1 << INT1)) {
+					INT1_vect();
+					sim_check_coil(&ss, st, tick);
+				}
+				sim_end_cycle(s, &ss, st, t);
+				if (_events)
+					sim_drain_events(s);
+			}
+		}
+	}
+}
+
+/* Przesunięcie timera 1 (liczy bez zerowania) o 1/2 obrotu, z przerwaniem przepełnienia */
+static void sim_bench_ticks(uint16_t ticks) {
+	uint16_t prev = TCNT1;
+
+	TCNT1 += ticks;
+	if (TCNT1 < prev)
+		TIMER1_OVF_vect();
+}
+
+/* Czas wykonania przerwań czujnika wału przy stałych obrotach */
+static double sim_bench_isr(unsigned int rpm) {
+	uint16_t half = (SIM_TICKS_PER_SEC * 30UL) / rpm;
+	double t0;
+	long i;
+
+	sim_reset();
+
+	/* Rozpędzenie - wypełnienie historii i włączenie mapy */
+	for(i = 0; i < 64; i++) {
+		sim_bench_ticks(half);
+		INT1_vect();
+		sim_bench_ticks(half);
+		INT0_vect();
+	}
+
+	t0 = sim_now_ns();
+	for(i = 0; i < SIM_BENCH_CALLS; i++) {
+		sim_bench_ticks(half);
+		INT1_vect();
+		sim_bench_ticks(half);
+		INT0_vect();
+	}
+
+	return (sim_now_ns() - t0) / (2.0 * SIM_BENCH_CALLS);
+}
+
+static void sim_print(const struct sim_scenario * s, const struct sim_stats * st) {
+	struct timing_stats fw;
+	int16_t offsets[MAP_RPM_SIZE];
+	double mean = 0.0, rms = 0.0, fw_mean = 0.0, fw_max = 0.0;
+
+	if (st->measured) {
+		mean = st->err_sum / st->measured;
+		rms = sqrt(st->err_sq_sum / st->measured);
+	}
+
+	/* Statystyki firmware (błąd w 1/8°) */
+	timing_read(&fw, offsets);
+	if (fw.count) {
+		fw_mean = (double)fw.sum / fw.count / (1 << TIMING_ERROR_SHIFT);
+		fw_max = (double)((-fw.min > fw.max) ? -fw.min : fw.max) / (1 << TIMING_ERROR_SHIFT);
+	}
+
+	printf("%-14s %7lu %7lu %6lu %6lu %7lu %9.2f %8.2f %8.2f %8.2f %8.2f %9.2f %9.2f\n", s->name, st->edges, st->sparks, st->missed, st->unexpected,
+	       st->skipped, mean, rms, st->err_max, fw_mean, fw_max, st->dwell_min * 1000.0 / SIM_TICKS_PER_SEC, st->dwell_max * 1000.0 / SIM_TICKS_PER_SEC);
+}
+
+/*
+ * Każdy przebieg wykonywany jest w osobnym procesie, aby zmienne statyczne
+ * firmware startowały od zera (jak po włączeniu zasilania).
+ * Zwraca 1 w procesie potomnym, 0 w rodzicu (po zakończeniu potomka).
+ * Potomek kończy się kodem SIM_EXIT_MISSED, jeżeli wypadła jakaś iskra -
+ * symulacja idzie dalej, ale na końcu zwraca błąd.
+ */
+static int sim_fork(void) {
+	pid_t pid;
+	int status;
+
+	fflush(stdout);
+	if (_csv)
+		fflush(_csv);
+	if (_events)
+		fflush(_events);
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		exit(1);
+	}
+
+	if (pid == 0)
+		return 1;
+
+	waitpid(pid, &status, 0);
+	if ((WIFEXITED(status)) && (WEXITSTATUS(status) == SIM_EXIT_MISSED)) {
+		_missed_fail = 1;
+		return 0;
+	}
+	if ((!WIFEXITED(status)) || (WEXITSTATUS(status))) {
+		fprintf(stderr, "Symulacja przerwana (status %d)\n", status);
+		exit(1);
+	}
+	return 0;
+}
+
+static void sim_exit(int code) {
+	fflush(stdout);
+	if (_csv)
+		fflush(_csv);
+	if (_events)
+		fflush(_events);
+	_exit(code);
+}
+
+static void usage(const char * name) {
+	fprintf(stderr, "Uzycie: %s [-s scenariusz] [-c plik.csv] [-e plik.csv] [-p nr=wartosc] [-l]\n", name);
+	fprintf(stderr, "  -s  uruchom tylko wybrany scenariusz\n");
+	fprintf(stderr, "  -c  zapisz kazda iskre do pliku CSV\n");
+	fprintf(stderr, "  -e  zapisz dziennik zdarzen firmware do pliku CSV\n");
+	fprintf(stderr, "  -p  nadpisz parametr ECU (numer z params.h)\n");
+	fprintf(stderr, "  -l  wypisz liste scenariuszy\n");
+}
+
+int main(int argc, char * argv[]) {
+	const char * only = NULL;
+	struct sim_stats st;
+	unsigned int i;
+	int opt, id, value;
+
+	while((opt = getopt(argc, argv, "s:c:e:p:lh")) != -1) {
+		switch(opt) {
+			case 's': {
+				only = optarg;
+				break;
+			}
+			case 'c': {
+				_csv = fopen(optarg, "w");
+				if (!_csv) {
+					perror(optarg);
+					return 1;
+				}
+				fprintf(_csv, "scenario,time,rpm,commanded,achieved,error\n");
+				break;
+			}
+			case 'e': {
+				_events = fopen(optarg, "w");
+				if (!_events) {
+					perror(optarg);
+					return 1;
+				}
+				fprintf(_events, "scenario,revolution,tdc_time,bdc_time,half_time,acceleration,spark_time,coil_off_time,flags,lost\n");
+				break;
+			}
+			case 'p': {
+				if ((sscanf(optarg, "%d=%d", &id, &value) != 2) || (id < 0) || (id >= PARAM_COUNT)) {
+					usage(argv[0]);
+					return 1;
+				}
+				_test_params[id] = value;
+				break;
+			}
+			case 'l': {
+				_list_only = 1;
+				break;
+			}
+			default: {
+				usage(argv[0]);
+				return 1;
+			}
+		}
+	}
+
+	if (_list_only) {
+		for(i = 0; i < SIM_SCENARIOS; i++)
+			printf("%s\n", _scenarios[i].name);
+		return 0;
+	}
+
+	printf("%-14s %7s %7s %6s %6s %7s %9s %8s %8s %8s %8s %9s %9s\n", "scenario", "edges", "sparks", "missed", "unexp",
+	       "skipped", "err_mean", "err_rms", "err_max", "fw_mean", "fw_max", "dwell_min", "dwell_max");
+
+	for(i = 0; i < SIM_SCENARIOS; i++) {
+		if ((only) && (strcmp(only, _scenarios[i].name)))
+			continue;
+
+		if (sim_fork()) {
+			sim_run(&_scenarios[i], &st);
+			sim_print(&_scenarios[i], &st);
+			sim_exit(st.missed ? SIM_EXIT_MISSED : 0);
+		}
+	}
+
+	if (!only) {
+		printf("\nisr_ns/edge:");
+		for(i = 0; i < SIM_BENCH_RPMS; i++) {
+			if (sim_fork()) {
+				printf(" %u rpm %.1f", _bench_rpms[i], sim_bench_isr(_bench_rpms[i]));
+				sim_exit(0);
+			}
+		}
+		printf("\n");
+	}
+
+	if (_csv)
+		fclose(_csv);
+	if (_events)
+		fclose(_events);
+
+	if (_missed_fail) {
+		fprintf(stderr, "Wypadly iskry (kolumna missed)\n");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,26 @@
+#include <stdint.h>
+#include "interface.h"
+#include "immo.h"
+
+/* Zaślepki modułów, które nie biorą udziału w symulacji (USB, immobilizer) */
+
+uint8_t __immo_locked;
+uint8_t __immo_keys[IMMO_KEYS][IMMO_KEY_LEN + 1];
+
+#ifndef SIM_USB /* ecu-emu używa prawdziwego interface.c */
+void interface_init(void) {
+
+}
+
+void interface_loop(void) {
+
+}
+#endif
+
+void immo_init(void) {
+	__immo_locked = 0;
+}
+
+void immo_keys_save(void) {
+
+}
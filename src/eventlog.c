@@ -0,0 +1,41 @@
+#include <util/atomic.h>
+#include <stdint.h>
+#include "eventlog.h"
+
+struct eventlog_entry __eventlog[EVENTLOG_SIZE];
+volatile uint8_t __eventlog_head;
+volatile uint8_t __eventlog_tail;
+volatile uint16_t __eventlog_lost;
+volatile uint8_t __eventlog_enabled;
+
+/* Włączenie / wyłączenie zapisu, kolejka i licznik utraconych wpisów są zerowane */
+void eventlog_enable(uint8_t enabled) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		__eventlog_enabled = enabled;
+		__eventlog_tail = __eventlog_head;
+		__eventlog_lost = 0;
+	}
+}
+
+/* Pobranie najstarszego wpisu (pętla główna), zwraca 0 gdy kolejka pusta */
+uint8_t eventlog_read(struct eventlog_entry * entry) {
+	uint8_t tail = __eventlog_tail;
+	
+	if (tail == __eventlog_head)
+		return 0;
+	
+	*entry = __eventlog[tail];
+	__asm__ __volatile__ ("" ::: "memory"); /* Wpis musi być skopiowany przed zwolnieniem miejsca */
+	__eventlog_tail = (tail + 1) & (EVENTLOG_SIZE - 1);
+	return 1;
+}
+
+/* Ilość wpisów utraconych z powodu pełnej kolejki (od włączenia) */
+uint16_t eventlog_lost(void) {
+	uint16_t lost;
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		lost = __eventlog_lost;
+	}
+	return lost;
+}
@@ -0,0 +1,61 @@
+#ifndef __EVENTLOG_H
+#define __EVENTLOG_H
+
+#include <stdint.h>
+
+/*
+ * Dziennik zdarzeń zapłonu - jeden wpis na obrót wału, zapisywany w GMP.
+ * Kolejka jednego producenta (INT1) i jednego konsumenta (pętla główna):
+ * głowę zmienia tylko przerwanie, ogon tylko pętla główna, więc nie są
+ * potrzebne blokady. Gdy kolejka jest pełna wpis jest tracony i zliczany
+ * w __eventlog_lost.
+ */
+
+#ifndef EVENTLOG_SHIFT
+#define EVENTLOG_SHIFT          4 /* log2 z ilości wpisów w kolejce */
+#endif
+#define EVENTLOG_SIZE           (1 << EVENTLOG_SHIFT)
+
+#define EVENTLOG_ENTRY_SIZE     14 /* Rozmiar wpisu w ramce FRAME_EVENT_LOG */
+
+struct eventlog_entry {
+	uint8_t revolution; /* Numer obrotu (__revolutions, przepełnia się) */
+	uint16_t tdc_time; /* Zmierzony czas 1/2 obrotu DMP -> GMP */
+	uint16_t bdc_time; /* Zmierzony czas 1/2 obrotu GMP -> DMP */
+	uint16_t half_time; /* Uśredniony czas 1/2 obrotu */
+	int16_t acceleration; /* __crank_acceleration */
+	uint16_t spark_time; /* Czas iskry zaplanowany w DMP, liczony od DMP (0 - iskra w GMP) */
+	uint16_t coil_off_time; /* Czas iskry liczony od DMP (TCNT1) */
+	uint8_t flags; /* ECU_FLAG_* */
+};
+
+extern struct eventlog_entry __eventlog[EVENTLOG_SIZE];
+extern volatile uint8_t __eventlog_head;
+extern volatile uint8_t __eventlog_tail;
+extern volatile uint16_t __eventlog_lost;
+extern volatile uint8_t __eventlog_enabled;
+
+void eventlog_enable(uint8_t enabled);
+uint8_t eventlog_read(struct eventlog_entry * entry);
+uint16_t eventlog_lost(void);
+
+/* Wolny wpis do wypełnienia w przerwaniu, NULL gdy dziennik wyłączony lub kolejka pełna */
+static inline struct eventlog_entry * eventlog_reserve(void) {
+	if (!__eventlog_enabled)
+		return 0;
+	
+	if (((__eventlog_head + 1) & (EVENTLOG_SIZE - 1)) == __eventlog_tail) {
+		__eventlog_lost++;
+		return 0;
+	}
+	
+	return &__eventlog[__eventlog_head];
+}
+
+/* Publikacja wpisu zwróconego przez eventlog_reserve() */
+static inline void eventlog_commit(void) {
+	__asm__ __volatile__ ("" ::: "memory"); /* Wpis musi być zapisany przed przesunięciem głowy */
+	__eventlog_head = (__eventlog_head + 1) & (EVENTLOG_SIZE - 1);
+}
+
+#endif /* __EVENTLOG_H */
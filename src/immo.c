@@ -1,11 +1,11 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
-#include <avr/eeprom.h>
 #include <util/delay.h>
 #include <stdint.h>
 #include <string.h>
 #include "immo.h"
 #include "params.h"
+#include "storage.h"
 
 #define IMMO_LIGHT_DDR      DDRB
 #define IMMO_LIGHT_PORT     PORTB
@@ -23,8 +23,6 @@ uint8_t __immo_keys[IMMO_KEYS][IMMO_KEY_LEN + 1]; /* = {
 	{ "000000000000" },
 };*/
 
-static uint8_t _ee_immo_keys[IMMO_KEYS][IMMO_KEY_LEN + 1] EEMEM;
-
 ISR(USART1_RX_vect) {
 	uint8_t c = UDR1;
 	static uint8_t bufidx = 0;
@@ -56,13 +54,11 @@ ISR(USART1_RX_vect) {
 }
 
 void immo_keys_save(void) {
-	eeprom_busy_wait();
-	eeprom_update_block(__immo_keys, _ee_immo_keys, IMMO_KEYS * (IMMO_KEY_LEN + 1));
+	storage_save(STORAGE_IMMO);
 }
 
 void immo_init(void) {
-	eeprom_busy_wait();
-	eeprom_read_block(__immo_keys, _ee_immo_keys, IMMO_KEYS * (IMMO_KEY_LEN + 1));
+	storage_load(STORAGE_IMMO);
 	
 	IMMO_LIGHT_DDR |= (1 << IMMO_LIGHT_PINNO);	
 	
@@ -4,45 +4,34 @@
 #include <avr/wdt.h>
 #include <stdint.h>
 #include <string.h>
-#include <stdio.h>
-#include <ctype.h>
+#include <util/crc16.h>
 #include "Descriptors.h"
 #include "interface.h"
 #include "map.h"
 #include "immo.h"
 #include "params.h"
+#include "sensors.h"
+#include "eventlog.h"
+#include "parser.h"
+#include "timing.h"
 #include <LUFA/Drivers/USB/USB.h>
 #include <LUFA/Platform/Platform.h>
 
-#define DATA_BUFSZ            512
+#define STREAM_KEEPALIVE      250 /* Maksymalny odstęp między ramkami w trybie co obrót [ms] */
+#define EVENTLOG_FRAME_ENTRIES  8 /* Maksymalna ilość wpisów dziennika w jednej ramce */
+#define RX_PACKETS            8 /* Maksymalna ilość pakietów odbieranych w jednym przebiegu pętli */
+#define MAP_SAVE_DELAY        2000 /* Zapis mapy do eeprom po tylu ms bez zmian komórek (polecenie 'c') [ms] */
 
-static FILE _stdout;
 static uint8_t _is_connected = 0;
-
-static inline uint8_t hex2int8(uint8_t * data) {
-	uint8_t res = 0;
-	
-	if ((data[0] >= '0') && (data[0] <= '9')) {
-		res = (data[0] - '0') << 4;
-	}
-	else if ((toupper(data[0]) >= 'A') && (toupper(data[0]) <= 'F')) {
-		res = (toupper(data[0]) - 'A' + 10) << 4;
-	}
-	
-	
-	if ((data[1] >= '0') && (data[1] <= '9')) {
-		res |= data[1] - '0';
-	}
-	else if ((toupper(data[1]) >= 'A') && (toupper(data[1]) <= 'F')) {
-		res |= toupper(data[1]) - 'A' + 10;
-	}
-	
-	return res;
-}
-
-static inline uint16_t hex2int16(uint8_t * data) {
-	return (hex2int8(data) << 8) | hex2int8(&data[2]);	
-}
+static uint16_t _stream_period = STREAM_OFF; /* Okres transmisji ciągłej [ms] */
+static uint16_t _stream_last; /* Czas wysłania ostatniej ramki [ms] */
+static uint8_t _stream_revolutions; /* Licznik obrotów przy ostatniej ramce */
+static uint8_t _stream_seq;
+static uint16_t _time_ms; /* Czas [ms] liczony z numerów ramek USB (SOF) */
+static uint16_t _last_frame_number;
+static uint8_t _map_save_pending; /* Komórki zmienione poleceniem 'c', mapa jeszcze nie zapisana */
+static uint16_t _map_save_time; /* Czas ostatniej zmiany komórek [ms] */
+static struct parser _parser;
 
 static USB_ClassInfo_CDC_Device_t _CDC_Interface = {
 	.Config = {
@@ -50,12 +39,12 @@ static USB_ClassInfo_CDC_Device_t _CDC_Interface = {
 			.DataINEndpoint           = {
 					.Address          = CDC_TX_EPADDR,
 					.Size             = CDC_TXRX_EPSIZE,
-					.Banks            = 1,
+					.Banks            = 2,
 				},
 			.DataOUTEndpoint = {
 					.Address          = CDC_RX_EPADDR,
 					.Size             = CDC_TXRX_EPSIZE,
-					.Banks            = 1,
+					.Banks            = 2, /* Host wysyła następny pakiet, gdy poprzedni jest przetwarzany */
 				},
 			.NotificationEndpoint = {
 					.Address          = CDC_NOTIFICATION_EPADDR,
@@ -75,6 +64,8 @@ void EVENT_USB_Device_Connect(void) {
 
 void EVENT_USB_Device_Disconnect(void) {
 	_is_connected = 0;
+	_stream_period = STREAM_OFF;
+	eventlog_enable(0);
 }
 
 void EVENT_USB_Device_ConfigurationChanged(void) {
@@ -87,94 +78,259 @@ void interface_init(void) {
 	wdt_disable();
 	
 	USB_Init();
-	CDC_Device_CreateStream(&_CDC_Interface, &_stdout);
-	stdout = &_stdout;
 }
 
-static uint8_t interface_exec(uint8_t * data, uint16_t datasz) {
+/*
+ * Odpowiedzi zapisywane są bezpośrednio do banku endpointu IN (bez stdio),
+ * pełny bank (CDC_TXRX_EPSIZE bajtów) jest od razu wysyłany. Niepełny pakiet
+ * wysyła CDC_Device_USBTask() na końcu interface_loop().
+ */
+static void resp_data(const void * data, uint8_t datasz) {
+	const uint8_t * p = data;
+	
+	if ((USB_DeviceState != DEVICE_STATE_Configured) || (!_CDC_Interface.State.LineEncoding.BaudRateBPS))
+		return;
+	
+	Endpoint_SelectEndpoint(_CDC_Interface.Config.DataINEndpoint.Address);
+	while (datasz--) {
+		if (!Endpoint_IsReadWriteAllowed()) { /* Bank pełny - wysyłamy pakiet */
+			Endpoint_ClearIN();
+			if (Endpoint_WaitUntilReady() != ENDPOINT_READYWAIT_NoError)
+				return;
+		}
+		Endpoint_Write_8(*p++);
+	}
+}
+
+static inline void resp_char(uint8_t c) {
+	resp_data(&c, 1);
+}
+
+static void resp_str(const char * str) {
+	resp_data(str, strlen(str));
+}
+
+static void resp_uint(uint16_t value) {
+	uint8_t buf[5];
+	uint8_t i = sizeof(buf);
+	
+	do {
+		buf[--i] = '0' + (value % 10);
+		value /= 10;
+	} while (value);
+	
+	resp_data(&buf[i], sizeof(buf) - i);
+}
+
+static void resp_int(int16_t value) {
+	if (value < 0) {
+		resp_char('-');
+		resp_uint(-(uint16_t)value);
+	}
+	else {
+		resp_uint(value);
+	}
+}
+
+static void resp_hex8(uint8_t value) {
+	static const char digits[] = "0123456789abcdef";
+	uint8_t buf[2];
+	
+	buf[0] = digits[value >> 4];
+	buf[1] = digits[value & 0x0F];
+	resp_data(buf, 2);
+}
+
+static void resp_hex16(uint16_t value) {
+	resp_hex8(value >> 8);
+	resp_hex8(value & 0xFF);
+}
+
+static inline void resp_newline(void) {
+	resp_data("\r\n", 2);
+}
+
+static uint8_t interface_exec(struct parser * p) {
 	extern volatile int16_t __timming_advance; 
 	extern volatile int16_t __crank_acceleration;
 	extern volatile uint16_t __rpm;
-	extern volatile uint16_t __throttle_state;
+	extern volatile uint8_t __revolutions;
 	
+	struct sensors_data sensors;
+	struct timing_stats stats;
+	int16_t offsets[MAP_RPM_SIZE];
 	int i, col, row;
+	uint8_t err;
 	
-	if (data[0] == 'v') { /* Nazwa i wersja softu */
-		printf("\r\nMZ ECU, firmware version "FW_VERSION);
+	if (p->cmd == 'v') { /* Nazwa i wersja softu */
+		resp_str("\r\nMZ ECU, firmware version "FW_VERSION);
 		return 0;
 	}
-	else if (data[0] == 'd') { /* Odczyt aktualnych danych */
-		printf("\r\n%u %d %d %u", __rpm, __timming_advance, __crank_acceleration, __throttle_state);
+	else if (p->cmd == 'd') { /* Odczyt aktualnych danych */
+		sensors_read(&sensors);
+		resp_newline();
+		resp_uint(__rpm); resp_char(' ');
+		resp_int(__timming_advance); resp_char(' ');
+		resp_int(__crank_acceleration); resp_char(' ');
+		resp_uint(sensors.throttle); resp_char(' ');
+		resp_int(sensors.temp);
 		return 0;
 	}
-	else if (data[0] == 'g') { /* Odczyt parametru konfiguracji z eeprom */
-		i = hex2int8(&data[1]);
-		if (i >= PARAM_COUNT)
+	else if (p->cmd == 'l') { /* Transmisja ciągła ramek binarnych, okres w ms (0000 - wyłączona, ffff - co obrót) */
+		if (p->digits < 4)
 			return 0x01;
-		printf("\r\n%04x", __params[i]);
+		_stream_period = p->value;
+		_stream_last = _time_ms;
+		_stream_revolutions = __revolutions;
 		return 0x00;
 	}
-	else if (data[0] == 's') { /* Zapis parametru konfiguracji do eeprom */
-		i = hex2int8(&data[1]);
-		if (i >= PARAM_COUNT)
+	else if (p->cmd == 'e') { /* Dziennik zdarzeń (e01 - włączony, e00 - wyłączony), zwraca ilość utraconych wpisów */
+		if (p->digits >= 2)
+			eventlog_enable(p->value);
+		resp_newline();
+		resp_uint(eventlog_lost());
+		return 0;
+	}
+	else if (p->cmd == 't') { /* Błąd kąta iskry: ilość; min max średnia [1/8°]; histogram (po 1°); poprawka czasu iskry [1/16 tyknięcia] */
+		if (p->digits >= 2) { /* t00 - zerowanie statystyk, t01 / t02 - uczenie poprawki wyłączone / włączone */
+			if (p->value == 0x00)
+				timing_reset();
+			else if (p->value <= 0x02)
+				timing_set_learn(p->value - 1);
+			else
+				return 0x01;
+			return 0x00;
+		}
+		
+		timing_read(&stats, offsets);
+		resp_newline();
+		resp_uint(stats.count);
+		resp_char(';');
+		if (stats.count) {
+			resp_char(' '); resp_int(stats.min);
+			resp_char(' '); resp_int(stats.max);
+			resp_char(' '); resp_int(stats.sum / stats.count);
+		}
+		resp_char(';');
+		for(i = 0; i < TIMING_HIST_BINS; i++) {
+			resp_char(' ');
+			resp_uint(stats.histogram[i]);
+		}
+		resp_char(';');
+		for(i = 0; i < MAP_RPM_SIZE; i++) {
+			resp_char(' ');
+			resp_int(offsets[i]);
+		}
+		return 0x00;
+	}
+	else if (p->cmd == 'g') { /* Odczyt parametru konfiguracji z eeprom */
+		if (p->value >= PARAM_COUNT)
+			return 0x01;
+		resp_newline();
+		resp_hex16(__params[p->value]);
+		return 0x00;
+	}
+	else if (p->cmd == 's') { /* Zapis parametru konfiguracji do eeprom */
+		if (p->row >= PARAM_COUNT)
 			return 0x01;
-		__params[i] = hex2int16(&data[3]);
+		__params[p->row] = p->value;
 		params_save();
 		return 0x00;
 	}
-	else if (data[0] == 'r') { /* Odczyt mapy zapłonu */
+	else if (p->cmd == 'G') { /* Odczyt wielu parametrów: bez argumentu wszystkie, 2 cyfry - od parametru do końca, 4 cyfry - pierwszy i ilość */
+		if (p->digits >= 4) {
+			row = p->value >> 8;
+			i = p->value & 0xFF;
+		}
+		else {
+			row = (p->digits >= 2) ? p->value : 0;
+			i = PARAM_COUNT - row;
+		}
+		
+		if ((row >= PARAM_COUNT) || (i == 0) || (row + i > PARAM_COUNT))
+			return 0x01;
+		
+		resp_newline();
+		while (i--) {
+			resp_hex16(__params[row++]);
+			resp_char(' ');
+		}
+		return 0x00;
+	}
+	else if (p->cmd == 'S') { /* Zapis wielu parametrów: numer pierwszego + wartości po 4 cyfry, eeprom zapisywany raz */
+		i = (p->digits - 2) >> 2;
+		if ((p->digits < 6) || ((p->digits - 2) & 3) || (p->row + i > PARAM_COUNT))
+			return 0x01;
 		
-		for(row = 0; row < MAP_COUNT; row++) {
+		memcpy(&__params[p->row], p->args.params, i * sizeof(uint16_t));
+		params_save();
+		return 0x00;
+	}
+	else if (p->cmd == 'r') { /* Odczyt mapy zapłonu */
+		
+		for(row = 0; row < MAP_ROWS; row++) {
 			for(col = 0; col < MAP_RPM_SIZE; col++) {
-				printf("%d ", __ignition_map[row][col]);
+				resp_uint(__ignition_map[row / MAP_LOAD_SIZE][row % MAP_LOAD_SIZE][col]);
+				resp_char(' ');
 			}
 				
-			putchar(';'); putchar(' ');
+			resp_data("; ", 2);
 		}
 		return 0;
 	}
-	else if (data[0] == 'w') { /* Zapis mapy zapłonu */
-		col = 0; row = 0;
-		
-		for(i = 1; i < datasz; i++) {
-			if (data[i] == ';') { /* Następny wiersz */
-				row++;
-				col = 0;
-			}
-			else {
-				if ((row >= MAP_COUNT) || (col >= MAP_RPM_SIZE)) { /* Mapa za duża, coś skopane */
-					return 0x01;
-				}
-				
-				__ignition_map[row][col] = hex2int8(&data[i++]);				
-				col++;
-			}
+	else if (p->cmd == 'w') { /* Zapis mapy zapłonu (komórki odebrane przez parser do __map_staging), opcjonalnie '#' + CRC16 mapy */
+		if (p->row == PARSER_MAP_CRC) {
+			if (p->digits < 4)
+				return 0x01;
+			if (p->value != map_staging_crc())
+				return 0x03;
 		}
 		
-		/* Zapis do eeprom */
-		map_write();
+		err = map_commit();
+		if (!err)
+			_map_save_pending = 0; /* Cała mapa zapisana */
+		return err;
+	}
+	else if (p->cmd == 'c') { /* Zmiana komórek mapy: wiersz, kolumna, wartości (2 cyfry hex każde), eeprom zapisywany po MAP_SAVE_DELAY ms bez zmian */
+		if ((p->digits < 6) || (p->digits & 1))
+			return 0x01;
+		
+		err = map_set_cells(p->row, p->col, p->args.cells, (p->digits - 4) >> 1);
+		if (!err) {
+			_map_save_pending = 1;
+			_map_save_time = _time_ms;
+		}
+		return err;
+	}
+	else if (p->cmd == 'x') { /* Odczyt osi mapy zapłonu (obroty; obciążenie) */
+		resp_newline();
+		for(i = 0; i < MAP_RPM_SIZE; i++) {
+			resp_hex16(__map_rpm_axis[i]);
+			resp_char(' ');
+		}
+		resp_char(';');
+		for(i = 0; i < MAP_LOAD_SIZE; i++) {
+			resp_char(' ');
+			resp_hex16(__map_load_axis[i]);
+		}
 		return 0x00;
 	}
-	else if (data[0] == 'k') { /* Odczyt kodów immobilizera */
-		putchar('\r'); putchar('\n');			
+	else if (p->cmd == 'y') { /* Zapis osi mapy zapłonu (MAP_RPM_SIZE + MAP_LOAD_SIZE liczb, 4 znaki hex każda) */
+		if (p->digits < PARSER_AXES_DIGITS)
+			return 0x01;
+		
+		return map_set_axes(p->args.axes, &p->args.axes[MAP_RPM_SIZE]);
+	}
+	else if (p->cmd == 'k') { /* Odczyt kodów immobilizera */
+		resp_newline();
 		for(i = 0; i < IMMO_KEYS; i++) {
-			printf("%s ", __immo_keys[i]);
+			resp_str((char *)__immo_keys[i]);
+			resp_char(' ');
 		}		
 		return 0x00;
 	}
-	else if (data[0] == 'i') { /* Zapis kodów do immobilizera */
-		i = 0;
-		row = 0;		
-		for(row = 0; row < IMMO_KEYS; row++) {
-			col = 0;
-			while(++i < datasz) {
-				if ((data[i] == ' ') || (data[i] == '\n') || (data[i] == '\0') || (col >= IMMO_KEY_LEN)) {
-					break;
-				}
-				__immo_keys[row][col++] = data[i];
-			}
-		}
-		
+	else if (p->cmd == 'i') { /* Zapis kodów do immobilizera */
+		memcpy(__immo_keys, p->args.keys, sizeof(__immo_keys));
 		immo_keys_save();
 		return 0x00;
 	}
@@ -183,44 +339,167 @@ static uint8_t interface_exec(uint8_t * data, uint16_t datasz) {
 }
 
 static void interface_recv_byte(uint8_t data) {
-	static uint16_t bufidx;
-	static uint8_t buf[DATA_BUFSZ];
 	uint8_t err;
 	
-	if (data == '\n') { /* \n pomijamy */
+	if (!parser_feed(&_parser, data))
 		return;
+	
+	/* Koniec polecenia - jeżeli nie jest puste i odebrało się poprawnie, wykonujemy je */
+	if (!_parser.cmd)
+		err = 0;
+	else if (_parser.error)
+		err = _parser.error;
+	else
+		err = interface_exec(&_parser);
+	
+	parser_reset(&_parser);
+	
+	/* Wypisujemy kod błędu + prompt */
+	resp_newline();
+	resp_hex8(err);
+	resp_char('>');
+}
+
+/* Wysłanie ramki binarnej */
+static void interface_send_frame(uint8_t type, uint8_t * data, uint8_t datasz) {
+	uint16_t crc = 0xFFFF;
+	uint8_t i;
+	
+	crc = _crc_ccitt_update(crc, type);
+	crc = _crc_ccitt_update(crc, datasz);
+	for(i = 0; i < datasz; i++)
+		crc = _crc_ccitt_update(crc, data[i]);
+	
+	resp_char(FRAME_SYNC);
+	resp_char(type);
+	resp_char(datasz);
+	resp_data(data, datasz);
+	resp_char(crc & 0xFF);
+	resp_char(crc >> 8);
+}
+
+static inline uint8_t * put_uint16(uint8_t * data, uint16_t value) {
+	data[0] = value & 0xFF;
+	data[1] = value >> 8;
+	return data + 2;
+}
+
+/* Ramka z aktualnymi danymi (transmisja ciągła) */
+static void interface_stream(void) {
+	extern volatile int16_t __timming_advance; 
+	extern volatile int16_t __crank_acceleration;
+	extern volatile uint16_t __rpm;
+	extern volatile uint8_t __revolutions;
+	extern volatile uint8_t __ecu_flags;
+	
+	struct sensors_data sensors;
+	uint8_t frame[14];
+	uint8_t * p;
+	uint8_t revolutions;
+	
+	if (_stream_period == STREAM_OFF)
+		return;
+	
+	if (_stream_period == STREAM_EVERY_REVOLUTION) { /* Co obrót, a gdy wał stoi co STREAM_KEEPALIVE ms */
+		revolutions = __revolutions;
+		if ((revolutions == _stream_revolutions) && ((uint16_t)(_time_ms - _stream_last) < STREAM_KEEPALIVE))
+			return;
+		_stream_revolutions = revolutions;
+	}
+	else if ((uint16_t)(_time_ms - _stream_last) < _stream_period) {
+		return;
+	}
+	_stream_last = _time_ms;
+	
+	sensors_read(&sensors);
+	
+	p = frame;
+	*p++ = _stream_seq++;
+	p = put_uint16(p, _time_ms);
+	p = put_uint16(p, __rpm);
+	p = put_uint16(p, __timming_advance);
+	p = put_uint16(p, __crank_acceleration);
+	p = put_uint16(p, sensors.throttle);
+	p = put_uint16(p, sensors.temp);
+	*p = __ecu_flags;
+	
+	interface_send_frame(FRAME_LIVE_DATA, frame, sizeof(frame));
+}
+
+/* Opróżnianie dziennika zdarzeń - najwyżej jedna ramka na przebieg pętli, przerwania nigdy nie czekają */
+static void interface_eventlog(void) {
+	struct eventlog_entry entry;
+	uint8_t frame[2 + EVENTLOG_FRAME_ENTRIES * EVENTLOG_ENTRY_SIZE];
+	uint8_t * p;
+	uint8_t count;
+	
+	if (!__eventlog_enabled)
+		return;
+	
+	p = put_uint16(frame, eventlog_lost());
+	for(count = 0; (count < EVENTLOG_FRAME_ENTRIES) && (eventlog_read(&entry)); count++) {
+		*p++ = entry.revolution;
+		p = put_uint16(p, entry.tdc_time);
+		p = put_uint16(p, entry.bdc_time);
+		p = put_uint16(p, entry.half_time);
+		p = put_uint16(p, entry.acceleration);
+		p = put_uint16(p, entry.spark_time);
+		p = put_uint16(p, entry.coil_off_time);
+		*p++ = entry.flags;
 	}
 	
-	else if (data == '\r') { /* Koniec poecenia */
-		/* Jeżeli polecenie nie jest puste, wykonujemy je */
-		if (bufidx > 0)
-			err = interface_exec(buf, bufidx);
-		else
-			err = 0;
+	if (count)
+		interface_send_frame(FRAME_EVENT_LOG, frame, p - frame);
+}
+
+/*
+ * Odbiór wszystkich pakietów czekających w endpoincie OUT (najwyżej RX_PACKETS
+ * na przebieg pętli). Pakiet kopiowany jest do bufora i od razu zwalniany, aby
+ * host mógł wysyłać kolejny w trakcie przetwarzania - odpowiedzi zapisywane
+ * przez interface_recv_byte() wybierają endpoint IN.
+ */
+static void interface_receive(void) {
+	uint8_t buf[CDC_TXRX_EPSIZE];
+	uint8_t count, i, packets;
+	
+	if ((USB_DeviceState != DEVICE_STATE_Configured) || (!_CDC_Interface.State.LineEncoding.BaudRateBPS))
+		return;
+	
+	for(packets = 0; packets < RX_PACKETS; packets++) {
+		Endpoint_SelectEndpoint(_CDC_Interface.Config.DataOUTEndpoint.Address);
+		if (!Endpoint_IsOUTReceived())
+			return;
 		
-		/* Czyścimy bufor */
-		bufidx = 0;
-		memset(buf, 0x00, DATA_BUFSZ);
+		count = Endpoint_BytesInEndpoint();
+		for(i = 0; i < count; i++)
+			buf[i] = Endpoint_Read_8();
+		Endpoint_ClearOUT();
 		
-		/* Wypisujemy kod błędu + prompt */
-		printf("\r\n%02x>", err);
-	}
-	else { /* Normalne dane */
-		if (bufidx < DATA_BUFSZ) buf[bufidx++] = data;
+		for(i = 0; i < count; i++)
+			interface_recv_byte(buf[i]);
 	}
 }
 
 void interface_loop(void) {
-	int16_t data;	
+	uint16_t frame_number;
+	
+	/* Czas z numerów ramek USB (co 1 ms, 11 bitów) */
+	frame_number = USB_Device_GetFrameNumber();
+	_time_ms += (frame_number - _last_frame_number) & 0x07FF;
+	_last_frame_number = frame_number;
 	
 	if (_is_connected) { /* Jeżeli urządzenie jest podłączone do komputera, czytamy dane z USB */		
-		data = CDC_Device_ReceiveByte(&_CDC_Interface);
-		
-		if (data >= 0) { /* Sa nowe dane */
-			interface_recv_byte(data);
-		}
+		interface_receive();
+		interface_stream();
+		interface_eventlog();
 	}	
 	
+	/* Zmiany komórek zapisujemy dopiero, gdy przez chwilę nie ma kolejnych (albo diag-app się rozłączyło) */
+	if ((_map_save_pending) && ((!_is_connected) || ((uint16_t)(_time_ms - _map_save_time) >= MAP_SAVE_DELAY))) {
+		_map_save_pending = 0;
+		map_save();
+	}
+	
 	CDC_Device_USBTask(&_CDC_Interface);
 	USB_USBTask();
 }
@@ -1,6 +1,27 @@
 #ifndef __INTERFACE_H
 #define __INTERFACE_H
 
+#include <stdint.h>
+
+/*
+ * Ramki binarne wysyłane w trybie transmisji ciągłej (polecenie 'l'):
+ * FRAME_SYNC, typ, długość danych (n), dane (n bajtów), CRC16-CCITT (LE, liczone od typu do końca danych).
+ * Bajt FRAME_SYNC nigdy nie występuje w odpowiedziach tekstowych, więc ramki można
+ * odróżnić od odpowiedzi na polecenia. Liczby wielobajtowe zapisywane są jako little endian.
+ */
+#define FRAME_SYNC              0xA5
+#define FRAME_LIVE_DATA         0x01 /* seq, czas [ms] (16b), obroty, wyprzedzenie, przyspieszenie, przepustnica, temperatura, flagi */
+#define FRAME_EVENT_LOG         0x02 /* utracone wpisy (16b), wpisy dziennika zdarzeń po EVENTLOG_ENTRY_SIZE bajtów (eventlog.h) */
+
+#define STREAM_OFF              0x0000 /* Okres transmisji: wyłączona */
+#define STREAM_EVERY_REVOLUTION 0xFFFF /* Okres transmisji: ramka co obrót wału */
+
+/* Flagi stanu zapłonu (__ecu_flags) */
+#define ECU_FLAG_DYNAMIC        (1 << 0) /* Mapa zapłonu włączona */
+#define ECU_FLAG_CUT_OFF        (1 << 1) /* Zapłon odcięty (zbyt wysokie obroty) */
+#define ECU_FLAG_IMMO_LOCKED    (1 << 2) /* Immobilizer zablokowany */
+#define ECU_FLAG_LIMIT          (1 << 3) /* Ogranicznik obrotów cofa wyprzedzenie / pomija iskry */
+
 void interface_init(void);
 void interface_loop(void);
 
@@ -4,6 +4,7 @@
 #include <avr/wdt.h>
 #include <avr/eeprom.h>
 #include <util/delay.h>
+#include <util/atomic.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdio.h>
@@ -11,6 +12,10 @@
 #include "immo.h"
 #include "map.h"
 #include "params.h"
+#include "sensors.h"
+#include "eventlog.h"
+#include "storage.h"
+#include "timing.h"
 
 /* Definicje portów I/O */
 #define IGN_COIL_DDR        DDRB
@@ -19,6 +24,10 @@
 #define IGN_COIL_ON()       IGN_COIL_PORT |= (1 << IGN_COIL_PINNO)
 #define IGN_COIL_OFF()      IGN_COIL_PORT &= ~(1 << IGN_COIL_PINNO)
 #define IGN_COIL_STATE()    ((IGN_COIL_PORT & (1 << IGN_COIL_PINNO)) == (1 << IGN_COIL_PINNO))
+#define IGN_DWELL_LEAD      4 /* Początek ładowania bliżej niż tyle tyknięć od teraz - cewka włączana od razu (porównanie by nie zadziałało) */
+#ifndef IGN_DWELL_MARGIN_SHIFT
+#define IGN_DWELL_MARGIN_SHIFT 5 /* Ładowanie cewki liczone najpóźniej od GMP o 1/32 połówki wcześniej niż poprzednia 1/2 obrotu */
+#endif
 
 #define IDLE_SERVO_DDR      DDRB
 #define IDLE_SERVO_PORT     PORTB
@@ -46,118 +55,388 @@
 #define THROTTLE_PINNO      PD6
 #define THROTTLE_ADC        ADC9
 
-#define LAST_ROTATION_TIMES 8 /* Ilość ostatnich połówek z których liczymy średnią */
+/* Filtr czasu 1/2 obrotu */
+#define CRANK_FILTER_SMA    0 /* Średnia krocząca (suma bieżąca) z LAST_ROTATION_TIMES ostatnich połówek */
+#define CRANK_FILTER_EMA    1 /* Filtr wykładniczy, stała czasowa 2^CRANK_EMA_SHIFT połówek */
+#define CRANK_FILTER_LOOP   2 /* Sumowanie całej tablicy i dzielenie przy każdym zboczu (stara metoda, do porównań) */
+
+#ifndef CRANK_FILTER
+#define CRANK_FILTER        CRANK_FILTER_SMA
+#endif
+
+#ifndef LAST_ROTATION_SHIFT
+#define LAST_ROTATION_SHIFT 3 /* log2 z ilości ostatnich połówek z których liczymy średnią */
+#endif
+#define LAST_ROTATION_TIMES (1 << LAST_ROTATION_SHIFT) /* Ilość ostatnich połówek z których liczymy średnią */
+
+#ifndef CRANK_EMA_SHIFT
+#define CRANK_EMA_SHIFT     2
+#endif
+
+/* Przewidywanie czasu następnej 1/2 obrotu (DMP -> GMP) dla iskry planowanej w DMP */
+#define CRANK_PREDICT_DIFF   0 /* Średnia + przyspieszenie (różnica dwóch kolejnych średnich) - stara metoda */
+#define CRANK_PREDICT_LINEAR 1 /* Prosta dopasowana metodą najmniejszych kwadratów do CRANK_PREDICT_SIZE ostatnich połówek */
+#define CRANK_PREDICT_QUAD   2 /* Parabola (przyspieszenie zmienia się liniowo), jak wyżej */
+
+#ifndef CRANK_PREDICT
+#define CRANK_PREDICT       CRANK_PREDICT_LINEAR
+#endif
+
+#define CRANK_PREDICT_SIZE  8  /* Ilość ostatnich połówek, do których dopasowywana jest krzywa */
+#define CRANK_PREDICT_SHIFT 12 /* Współczynniki w stałym przecinku 4.12 */
+
+#ifndef CRANK_RESID_SHIFT
+#define CRANK_RESID_SHIFT   6  /* Dopuszczalna odchyłka ostatniej połówki od krzywej (1/64 połówki) */
+#endif
+
+#if (CRANK_PREDICT != CRANK_PREDICT_DIFF) && (LAST_ROTATION_TIMES < CRANK_PREDICT_SIZE)
+#error "CRANK_PREDICT wymaga LAST_ROTATION_SHIFT >= 3"
+#endif
 
 volatile int16_t __timming_advance = 0; /* Rzeczywiste wyprzedzenie zapłonu */
 volatile int16_t __crank_acceleration = 0;
 volatile uint16_t __rpm = 0;
-uint16_t __throttle_state = 0;
+volatile uint8_t __revolutions = 0; /* Licznik obrotów wału (przepełnia się) */
+volatile uint8_t __ecu_flags = 0; /* Stan zapłonu (ECU_FLAG_*) dla interfejsu */
 static uint16_t _coil_off_time;
 static uint16_t _half_times[LAST_ROTATION_TIMES]; /* Ostatnie czasy połówek obrotów */
-static uint16_t _last_half_time_idx = 0; /* Ostatni czas 1/2 obrotu */
+static uint8_t _last_half_time_idx = 0; /* Ostatni czas 1/2 obrotu */
 static uint16_t _half_time = 0; /* Uśredniony czas 1/2 obrotu */
+#if CRANK_FILTER == CRANK_FILTER_SMA
+static uint32_t _half_times_sum; /* Suma wszystkich czasów z _half_times */
+#elif CRANK_FILTER == CRANK_FILTER_EMA
+static uint32_t _half_time_ema; /* Czas 1/2 obrotu przesunięty o CRANK_EMA_SHIFT bitów (część ułamkowa) */
+#endif
 static uint8_t _ignition_cut_off = 0; /* Zapłon odcięty (zbyt wysokie obroty) */
+static uint16_t _limit_advance = 0x100; /* Ogranicznik obrotów - współczynnik wyprzedzenia z mapy (0.8) */
+static uint16_t _limit_skip; /* Ogranicznik obrotów - akumulator rozkładu pomijanych iskier (0.8) */
 static uint8_t _dynamic_timming = 0; /* Dunamiczna mapa zapłonu włączona */
 static uint16_t _stop_timer = 0; /* "Zegarek" liczący jak długo wał się nie kręci */
+static uint16_t _advance = 0; /* Wyprzedzenie z mapy dla następnej iskry (ułamek 1/2 obrotu, 0.16) */
+static uint8_t _advance_bin; /* Przedział osi obrotów dla _advance (poprawka czasu iskry) */
+static uint16_t _spark_advance; /* Wyprzedzenie zadane dla iskry w bieżącym obrocie (0 - iskra bez mapy) */
+static uint16_t _spark_target; /* Zadany czas iskry liczony od DMP (jak _coil_off_time) */
+static uint8_t _spark_bin;
+static uint16_t _bdc_time; /* Zmierzony czas 1/2 obrotu zakończonej w DMP (dziennik zdarzeń) */
+static uint16_t _spark_time; /* Czas iskry zaplanowany w DMP, liczony od DMP (dziennik zdarzeń) */
+static uint16_t _timer_high; /* Starsze słowo czasu - ilość przepełnień timera 1 */
+static uint32_t _last_edge; /* Czas ostatniego zbocza czujnika wału */
+static uint16_t _bdc_stamp; /* Młodsze słowo czasu DMP (iskra i _coil_off_time liczone są od DMP) */
 
-/* Obliczenia wykonywane w GMP i DMP */
-static inline void _crank_isr_common(void) {
-	uint32_t tmp;
+#if CRANK_PREDICT != CRANK_PREDICT_DIFF
+/*
+ * Współczynniki przewidywania (od najstarszej połówki) - dopasowanie metodą
+ * najmniejszych kwadratów h(x) = a + b*x [+ c*x^2] + s*(-1)^x do połówek
+ * x = 0..7 i wartość dla x = 8 to suma współczynnik * połówka. Składnik
+ * s*(-1)^x pochłania różnicę między połówkami GMP -> DMP i DMP -> GMP
+ * (sprężanie), więc nie przesuwa przewidywania. Suma współczynników = 4096.
+ */
+static const int16_t _predict_coeffs[CRANK_PREDICT_SIZE] = {
+#if CRANK_PREDICT == CRANK_PREDICT_LINEAR
+	-512, -1536, 512, -512, 1536, 512, 2560, 1536 /* (-1, -3, 1, -1, 3, 1, 5, 3) / 8 */
+#else
+	2048, -1170, -585, -2341, -293, -585, 2926, 4096 /* (7, -4, -2, -8, -1, -2, 10, 14) / 14 */
+#endif
+};
+
+/*
+ * Odchyłka ostatniej połówki (x = 7) od tej samej krzywej. Duża odchyłka
+ * oznacza, że przyspieszenie właśnie się zmieniło (koniec rozpędzania,
+ * rozruch) i krzywa z 8 połówek przestrzeliłaby - wtedy przewidywanie
+ * liczone jest prostą z 4 ostatnich połówek (szybciej nadąża, ale bardziej
+ * przenosi szum). Suma współczynników = 0.
+ */
+static const int16_t _resid_coeffs[CRANK_PREDICT_SIZE] = {
+#if CRANK_PREDICT == CRANK_PREDICT_LINEAR
+	922, -102, 307, -717, -307, -1331, -922, 2150 /* (9, -1, 3, -7, -3, -13, -9, 21) / 40 */
+#else
+	-273, -273, 819, 137, 546, -819, -1092, 955 /* (-2, -2, 6, 1, 4, -6, -8, 7) / 30 */
+#endif
+};
+#endif
+
+/*
+ * Czas 32-bit (tyknięcia timera 1, preskaler 64) - timer 1 liczy cały czas od
+ * startu i nie jest zerowany, starsze słowo liczy TIMER1_OVF_vect. Wołane
+ * w przerwaniu: jeżeli timer przepełnił się, a przerwanie przepełnienia
+ * jeszcze czeka, mała wartość TCNT1 należy już do następnego okresu.
+ */
+static inline uint32_t _timer_now(void) {
+	uint16_t low, high;
+	
+	low = TCNT1;
+	high = _timer_high;
+	if ((TIFR1 & (1 << TOV1)) && (low < 0x8000))
+		high++;
+	
+	return ((uint32_t)high << 16) | low;
+}
+
+/* Obliczenia wykonywane w GMP i DMP (czas zbocza odczytany na początku przerwania), zwraca zmierzony czas 1/2 obrotu */
+static inline uint16_t _crank_isr_common(uint32_t now) {
+	uint32_t elapsed;
+	uint16_t time;
 	uint8_t i;
+#if CRANK_FILTER == CRANK_FILTER_LOOP
+	uint32_t tmp;
+#endif
 	
-	/* Zapisujemy czas 1/2 obrotu */
-	_last_half_time_idx = (_last_half_time_idx + 1) % LAST_ROTATION_TIMES;	
-	_half_times[_last_half_time_idx] = TCNT1; 
-	TCNT1 = 0; /* Zerujemy timer0 */	
+	/* Czas 1/2 obrotu - różnica czasów zboczy (timer nie jest zerowany, więc nie gubi tyknięć) */
+	elapsed = now - _last_edge;
+	_last_edge = now;
+	time = (elapsed > 0xFFFF) ? 0xFFFF : elapsed;
+	_last_half_time_idx = (_last_half_time_idx + 1) & (LAST_ROTATION_TIMES - 1);
 	
-	if (!_half_time) { /* Wał rusza */
+	if ((!_half_time) || (elapsed > 0xFFFF)) { /* Wał rusza */
 		_stop_timer = 0;
-		_half_time = _half_times[_last_half_time_idx];
+		_half_time = time;
 		for(i = 0; i < LAST_ROTATION_TIMES; i++)
 			_half_times[i] = _half_time;
+#if CRANK_FILTER == CRANK_FILTER_SMA
+		_half_times_sum = (uint32_t)_half_time << LAST_ROTATION_SHIFT;
+#elif CRANK_FILTER == CRANK_FILTER_EMA
+		_half_time_ema = (uint32_t)_half_time << CRANK_EMA_SHIFT;
+#endif
 	}
 	else {
 		/* Obliczamy średnią czasów i przyspieszenie */
 		__crank_acceleration = _half_time;
+#if CRANK_FILTER == CRANK_FILTER_SMA
+		/* Suma bieżąca - odejmujemy najstarszy czas, dodajemy nowy */
+		_half_times_sum += time;
+		_half_times_sum -= _half_times[_last_half_time_idx];
+		_half_times[_last_half_time_idx] = time;
+		_half_time = _half_times_sum >> LAST_ROTATION_SHIFT;
+#elif CRANK_FILTER == CRANK_FILTER_EMA
+		_half_times[_last_half_time_idx] = time;
+		_half_time_ema -= _half_time_ema >> CRANK_EMA_SHIFT;
+		_half_time_ema += time;
+		_half_time = _half_time_ema >> CRANK_EMA_SHIFT;
+#else
+		_half_times[_last_half_time_idx] = time;
 		tmp = 0;
 		for(i = 0; i < LAST_ROTATION_TIMES; i++)
 			tmp += _half_times[i];
 		
 		_half_time = tmp / LAST_ROTATION_TIMES;
+#endif
 		__crank_acceleration -= _half_time;
 	}
+	
+	return time;
+}
+
+/* Przewidywany czas następnej 1/2 obrotu (stała ilość operacji - 2 * CRANK_PREDICT_SIZE mnożeń, najwyżej 4 więcej) */
+static inline uint16_t _crank_predict(void) {
+#if CRANK_PREDICT == CRANK_PREDICT_DIFF
+	return _half_time + __crank_acceleration;
+#else
+	int32_t sum = 0, resid = 0;
+	uint16_t last;
+	uint8_t i, idx;
+	
+	idx = _last_half_time_idx - (CRANK_PREDICT_SIZE - 1); /* Najstarsza z użytych połówek */
+	for(i = 0; i < CRANK_PREDICT_SIZE; i++, idx++) {
+		sum += (int32_t)_predict_coeffs[i] * _half_times[idx & (LAST_ROTATION_TIMES - 1)];
+		resid += (int32_t)_resid_coeffs[i] * _half_times[idx & (LAST_ROTATION_TIMES - 1)];
+	}
+	
+	last = _half_times[_last_half_time_idx];
+	if (resid < 0)
+		resid = -resid;
+	
+	if ((resid >> CRANK_PREDICT_SHIFT) > (last >> CRANK_RESID_SHIFT)) {
+		/* Prosta z 4 połówek: (-1, -3, 5, 3) / 4 */
+		idx = _last_half_time_idx;
+		sum = 3L * last;
+		sum += 5L * _half_times[(idx - 1) & (LAST_ROTATION_TIMES - 1)];
+		sum -= 3L * _half_times[(idx - 2) & (LAST_ROTATION_TIMES - 1)];
+		sum -= _half_times[(idx - 3) & (LAST_ROTATION_TIMES - 1)];
+		sum = (sum + 2) >> 2;
+	}
+	else
+		sum = (sum + (1L << (CRANK_PREDICT_SHIFT - 1))) >> CRANK_PREDICT_SHIFT;
+	
+	if (sum < 1)
+		sum = 1;
+	else if (sum > 0xFFFF)
+		sum = 0xFFFF;
+	
+	return sum;
+#endif
+}
+
+/*
+ * Progresywny ogranicznik obrotów: współczynnik wyprzedzenia z mapy (0.8,
+ * 0x100 - bez zmian) i gęstość pomijania iskier (0.8, 0x100 - wszystkie).
+ * Bez pętli i dzielenia - czas wykonania nie zależy od obrotów.
+ */
+static inline uint16_t _crank_limit(uint16_t * skip) {
+	uint16_t start = __params_half_time[PARAM_IGN_CUT_OFF_START];
+	
+	*skip = 0;
+	if ((!_half_time) || (_half_time >= __params_limit.soft)) /* Poniżej strefy (albo wał dopiero rusza) */
+		return 0x100;
+	
+	if (_half_time > start) /* Cofanie wyprzedzenia */
+		return ((uint32_t)(_half_time - start) * __params_limit.retard_scale) >> 8;
+	
+	*skip = (_half_time > __params_limit.hard) ? ((uint32_t)(start - _half_time) * __params_limit.skip_scale) >> 8 : 0x100;
+	return 0;
 }
 
 /* INT1 - przerwanie z czujnika położeniu wału (wał w GMP) */
 ISR(INT1_vect) {
-	TCNT3 = 0;
+	struct eventlog_entry * entry;
+	uint32_t now, achieved;
+	uint16_t time, skip;
+	
+	now = _timer_now();
+	TIMSK1 &= ~((1 << OCIE1A) | (1 << OCIE1B)); /* Iskra ani ładowanie cewki nie mogą wypaść w następnym obrocie */
 	if (IGN_COIL_STATE()) {
 		IGN_COIL_OFF(); /* Wyłączamy zasilanie cewki zapłonowej (jeżeli nie było iskry wcześniej - zapłon na pewno nie wypadnie) */
-		_coil_off_time = TCNT1;
+		_coil_off_time = (uint16_t)now - _bdc_stamp;
 	}
 	
-	_crank_isr_common();
+	time = _crank_isr_common(now);
+	sensors_crank_sync(); /* Pomiary analogowe zsynchronizowane z wałem (jeżeli włączone) */
 	
-	/* Odcięcie zapłonu */
-	if ((__rpm > __params[PARAM_IGN_CUT_OFF_START]) && (!_ignition_cut_off)) {
+	/* Odcięcie zapłonu (progi obrotów przeliczone na czas 1/2 obrotu - krótszy czas = wyższe obroty) */
+	if (__params_limit.soft) {
+		_limit_advance = _crank_limit(&skip);
+		
+		/*
+		 * Pomijanie iskier rozłożone równomiernie (Bresenham) - gęstość
+		 * dodawana co obrót, przepełnienie akumulatora odcina następną iskrę.
+		 */
+		_limit_skip += skip;
+		_ignition_cut_off = 0;
+		if (_limit_skip >= 0x100) {
+			_limit_skip -= 0x100;
+			_ignition_cut_off = 1;
+		}
+	}
+	else if ((_half_time < __params_half_time[PARAM_IGN_CUT_OFF_START]) && (!_ignition_cut_off)) {
 		_ignition_cut_off = 1;
 	}
-	else if ((_ignition_cut_off) && (__rpm < __params[PARAM_IGN_CUT_OFF_END])) {
+	else if ((_ignition_cut_off) && (_half_time > __params_half_time[PARAM_IGN_CUT_OFF_END])) {
 		_ignition_cut_off = 0;
 	}
 	
 	/* Włączanie / wyłaczanie mapy */
-	if ((__rpm > __params[PARAM_DYNAMIC_ON]) && (!_dynamic_timming)) {
+	if ((_half_time < __params_half_time[PARAM_DYNAMIC_ON]) && (!_dynamic_timming)) {
 		_dynamic_timming = 1;
 	}
-	else if ((__rpm < __params[PARAM_DYNAMIC_OFF]) && (_dynamic_timming)) {
+	else if ((_half_time > __params_half_time[PARAM_DYNAMIC_OFF]) && (_dynamic_timming)) {
 		_dynamic_timming = 0;
 	}
 
-	if ((_ignition_cut_off) || (!_dynamic_timming)) {
-		__timming_advance = __params[PARAM_CRANK_OFFSET];
+	if (_spark_advance) {
+		/* Rzeczywiste wyprzedzenie iskry z mijającego obrotu (względem zmierzonego czasu DMP -> GMP) i błąd względem zadanego */
+		achieved = (_coil_off_time < time) ? ((uint32_t)(time - _coil_off_time) << 16) / time : 0;
+		__timming_advance = ((180UL * achieved) >> 16) + __params[PARAM_CRANK_OFFSET];
+		timing_record((((int32_t)achieved - _spark_advance) * (180L << TIMING_ERROR_SHIFT)) >> 16);
+		timing_learn(_spark_bin, _coil_off_time - _spark_target);
 	}
 	else {
-		/* Obliczamy rzeczywiste wyprzedzenie zapłonu (do celów informacyjnych) */
-		__timming_advance = (180UL * (_half_time - _coil_off_time) / _half_time) + __params[PARAM_CRANK_OFFSET];
+		__timming_advance = __params[PARAM_CRANK_OFFSET];
+	}
+	
+	/* Wyprzedzenie dla następnej iskry - interpolacja mapy raz na obrót, w DMP zostaje tylko mnożenie */
+	if (_dynamic_timming) {
+		_advance = ((uint32_t)map_advance(_half_time, sensors_throttle()) * _limit_advance) >> 8;
+		_advance_bin = map_rpm_index(_half_time);
+	}
+	
+	__ecu_flags = (_dynamic_timming ? ECU_FLAG_DYNAMIC : 0) | (_ignition_cut_off ? ECU_FLAG_CUT_OFF : 0) | (__immo_locked ? ECU_FLAG_IMMO_LOCKED : 0) |
+	              ((_limit_advance < 0x100) ? ECU_FLAG_LIMIT : 0);
+	__revolutions++;
+	
+	/* Dziennik zdarzeń - iskra z mijającego obrotu */
+	entry = eventlog_reserve();
+	if (entry) {
+		entry->revolution = __revolutions;
+		entry->tdc_time = time;
+		entry->bdc_time = _bdc_time;
+		entry->half_time = _half_time;
+		entry->acceleration = __crank_acceleration;
+		entry->spark_time = _spark_time;
+		entry->coil_off_time = _coil_off_time;
+		entry->flags = __ecu_flags;
+		eventlog_commit();
 	}
 }
 
 /* INT0 - przerwanie z czujnika położeniu wału (wał w DMP) */
 ISR(INT0_vect) {
-	uint32_t tmp;
+	uint32_t now;
+	uint16_t time, spark, limit;
 	
-	_crank_isr_common();
+	now = _timer_now();
+	_bdc_time = _crank_isr_common(now);
+	_bdc_stamp = now;
+	_spark_advance = 0;
+	_spark_time = 0;
 	
 	if (!_half_time)
 		return;
 	
-	/* Obliczamy obroty / minute */
-	__rpm = ((60UL * (F_CPU / 64)) / _half_time) >> 1;
+	if ((!_ignition_cut_off) && (!__immo_locked)) {
+		time = _crank_predict();
+		spark = 0; /* Bez mapy iskrę daje wyłączenie cewki w GMP */
+		
+		/* Mapa zapłonu włączona - iskra przed GMP (przy wyprzedzeniu mniejszym niż bazowe i bez mapy cewkę wyłącza GMP) */
+		if ((_dynamic_timming) && (_advance)) {
+			/*
+			 * Kiedy ma być iskra (ułamek 1/2 obrotu wyliczony w GMP) - porównanie
+			 * z czasem liczonym od zbocza DMP, więc opóźnienie wejścia do
+			 * przerwania nie przesuwa iskry. Poprawka na opóźnienie przerwania
+			 * porównania uczona jest dla przedziału obrotów w timing.c.
+			 */
+			_spark_target = time - (((uint32_t)time * _advance) >> 16);
+			_spark_advance = _advance;
+			_spark_bin = _advance_bin;
+			_spark_time = _spark_target - timing_offset(_spark_bin);
+			
+			OCR1A = _bdc_stamp + _spark_time;
+			TIFR1 = (1 << OCF1A); /* Kasujemy stare dopasowanie */
+			TIMSK1 |= (1 << OCIE1A);
+			spark = _spark_time;
+		}
 		
-	if ((!_ignition_cut_off) && (__rpm > 0) && (!__immo_locked)) {
+		/*
+		 * Stały czas ładowania cewki - włączenie w porównaniu B na tej samej
+		 * podstawie czasu co iskra. Gdy 1/2 obrotu jest krótsza niż czas
+		 * ładowania (albo czas nie jest ustawiony) cewka włączana jest w DMP.
+		 * Bez iskry z mapy cewka też jest włączana w DMP - GMP liczony od
+		 * przewidywanego czasu przy rozruchu przychodzi przed porównaniem B,
+		 * które INT1 wyłącza, i iskra by wypadła. Z tego samego powodu
+		 * początek ładowania nie może wypaść później niż najwcześniejszy
+		 * prawdopodobny GMP (zmierzona 1/2 obrotu minus margines), nawet
+		 * gdy przewidywanie spóźnia iskrę przy mocnym przyspieszaniu.
+		 */
+		limit = _bdc_time - (_bdc_time >> IGN_DWELL_MARGIN_SHIFT);
+		if (spark > limit)
+			spark = limit;
 		
-		if (_dynamic_timming) { /* Mapa zapłonu włączona */
-			/* Obliczamy kiedy ma być iskra */
-			if (__ignition_map[__params[PARAM_CURRENT_MAP]][__rpm / 500] <= __params[PARAM_CRANK_OFFSET]) { /* wyprzedzenie mniejsze niż bazowe - nie jesteśmy w stanie tego zrobić */
-				TCNT3 = 0;
-			}
-			else {
-				tmp = ((uint32_t)(_half_time + __crank_acceleration) * (uint32_t)(__ignition_map[__params[PARAM_CURRENT_MAP]][__rpm / 500] - __params[PARAM_CRANK_OFFSET])) / 180UL;
-				TCNT3 = 0xFFFF - _half_time - __crank_acceleration + tmp;
-			}
+		if ((spark) && (__params_dwell_ticks) && (spark > __params_dwell_ticks) &&
+		    ((uint16_t)(spark - __params_dwell_ticks) > (uint16_t)(TCNT1 - _bdc_stamp) + IGN_DWELL_LEAD)) {
+			OCR1B = _bdc_stamp + spark - __params_dwell_ticks;
+			TIFR1 = (1 << OCF1B);
+			TIMSK1 |= (1 << OCIE1B);
 		}
 		else {
-			TCNT3 = 0;
+			IGN_COIL_ON();
 		}
-
-		IGN_COIL_ON();
 	}
-	
-	TCNT3 += TCNT1; /* Korekta o czas wykonywania kodu przerwania */
 }
 
-ISR(TIMER1_OVF_vect) { /* Przepełnia się gdy nie ma impulsu (wał się nie kręci) */
+ISR(TIMER1_OVF_vect) { /* Co 65536 tyknięć - starsze słowo czasu */
+	_timer_high++;
+	
+	if ((((uint32_t)_timer_high << 16) - _last_edge) <= 0xFFFF) /* Wał się kręci - zbocze w ciągu ostatniego okresu timera */
+		return;
+	
 	_stop_timer++; /* Zwiększamy timer stopu */
 	
 	if (_stop_timer > 10) { /* Po kilkunastu sekundach wyłączamy zasilanie cewki, aby nie marnowała prądu i się nie grzała niepotrzebnie */
@@ -167,16 +446,30 @@ ISR(TIMER1_OVF_vect) { /* Przepełnia się gdy nie ma impulsu (wał się nie kr
 	_half_time = 0;
 	__rpm = 0;
 	_ignition_cut_off = 0;
+	
+	sensors_crank_sync(); /* Wał stoi - pomiary i tak muszą być odświeżane */
 }
 
-ISR(TIMER3_OVF_vect) { /* Przerwanie timera sterujacego cewką zapłonową */
+ISR(TIMER1_COMPA_vect) { /* Czas iskry ustawiony w DMP */
+	TIMSK1 &= ~(1 << OCIE1A); /* Jedna iskra na obrót */
+	
 	if ((!_half_time) || (_ignition_cut_off) || (__immo_locked)) {
 		return;
 	}
 	
 	/* Wyłączamy zasilanie cewki i zapisujemy czas */
 	IGN_COIL_OFF();
-	_coil_off_time = TCNT1;
+	_coil_off_time = TCNT1 - _bdc_stamp;
+}
+
+ISR(TIMER1_COMPB_vect) { /* Początek ładowania cewki ustawiony w DMP */
+	TIMSK1 &= ~(1 << OCIE1B);
+	
+	if ((!_half_time) || (_ignition_cut_off) || (__immo_locked)) {
+		return;
+	}
+	
+	IGN_COIL_ON();
 }
 
 void init(void) {	
@@ -199,6 +492,9 @@ void init(void) {
 	THROTTLE_DDR &= ~(1 << THROTTLE_PINNO);	
 	DIDR2 |= (1 << ADC9D) | (1 << ADC8D);
 	
+	/* Zapis konfiguracji do eeprom w tle */
+	storage_init();
+	
 	/* Parametry modułu */
 	params_init();
 	
@@ -211,6 +507,12 @@ void init(void) {
 	/* Mapa zapłonu */
 	map_init();
 	
+	/* Pomiary analogowe (przepustnica, temperatura) */
+	sensors_init();
+	
+	/* Statystyki kąta iskry */
+	timing_reset();
+	
 	/* INT0, aktywacja zboczem opadającym */
 	EICRA &= ~(1 << ISC00);
 	EICRA |= (1 << ISC01);
@@ -220,64 +522,35 @@ void init(void) {
 	EICRA |= (1 << ISC11) | (1 << ISC10);
 	EIMSK |= (1 << INT1);
 	
-	/* Timer 1 - odmierzanie czasu między impulsami */
+	/* Timer 1 - czas zboczy czujnika wału (liczy cały czas, bez zerowania), iskra w porównaniu A, ładowanie cewki w porównaniu B */
 	TCCR1B |= (1 << CS11) | (1 << CS10);
 	TIMSK1 |= (1 << TOIE1);
 
-	/* Timer 3 - wyzwalanie iskry, taki sam preskaler */
-	TCCR3B |= (1 << CS31) | (1 << CS30);
-	TIMSK3 |= (1 << TOIE3);
-
 	sei();
 }
 
-void write_to_eeprom(void) {
+/* Obroty / minutę liczone w pętli głównej (dzielenie 32-bitowe poza przerwaniami) */
+static void update_rpm(void) {
+	uint16_t half_time;
 	
-}
-
-#if 0
-int16_t read_temp(void) {
-	uint32_t data = 0;
-	
-	/* AREF = internal 2.56V, channel = 8 */
-	ADMUX = (1 << REFS0) | (1 << REFS1);
-	ADCSRB = (1 << MUX5);
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		half_time = _half_time;
+	}
 	
-	_delay_us(1);
-	ADCSRA = (1 << ADEN) | (1 << ADSC) | (1 << ADIF) | (1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0);
-	while(ADCSRA & (1 << ADSC));  /* Czekamy na zakonczenie konwersij */
-	ADCSRA = (1 << ADIF);
-		
-	data = ADC;
-	__throttle_state = data;
-	return ((data * 380UL) / 1024UL) - 80;
+	__rpm = half_time ? (((60UL * (F_CPU / 64)) / half_time) >> 1) : 0;
 }
 
-void read_throttle_state(void) {
-	uint16_t data = 0;
-	
-	/* AREF = internal 2.56V, channel = 9 */
-	ADCSRB = (1 << ADHSM) | (1 << MUX5);
-	ADMUX = (1 << REFS0) | (0 << REFS1) | (1 << MUX0);	
+void write_to_eeprom(void) {
 	
-	_delay_us(1);
-	ADCSRA = (1 << ADEN) | (1 << ADSC) | (1 << ADIF) | (1 << ADPS2) | (1 << ADPS1) | (0 << ADPS0);
-	while(ADCSRA & (1 << ADSC));  /* Czekamy na zakonczenie konwersij */
-	ADCSRA = (1 << ADIF);
-		
-	data = ADC;
-	__throttle_state = data;
 }
-#endif
+
 int main(void) {	
 	_delay_ms(100);
 	
 	init();
 	
 	while(1) {
-		//read_throttle_state();
-		//read_temp();
-		
+		update_rpm();
 		interface_loop();
 	}
 	return 0;
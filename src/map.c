@@ -1,16 +1,288 @@
-#include <avr/eeprom.h>
+#include <string.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
 #include "map.h"
+#include "params.h"
+#include "storage.h"
 
-uint8_t __ignition_map[MAP_COUNT][MAP_RPM_SIZE];
+uint8_t __ignition_map[MAP_COUNT][MAP_LOAD_SIZE][MAP_RPM_SIZE];
+uint8_t __map_staging[MAP_COUNT][MAP_LOAD_SIZE][MAP_RPM_SIZE]; /* Mapa odbierana przez interfejs (przed zatwierdzeniem) */
+uint16_t __map_rpm_axis[MAP_RPM_SIZE]; /* Punkty osi obrotów [RPM], rosnąco */
+uint16_t __map_load_axis[MAP_LOAD_SIZE]; /* Punkty osi obciążenia [odczyt ADC], rosnąco */
 
-static uint8_t _ee_ignition_map[MAP_COUNT][MAP_RPM_SIZE] EEMEM; /* Mapa zapisana w eeprom */
+/*
+ * Tablice używane w przerwaniach. Są dwa komplety - map_update() wypełnia
+ * nieaktywny i podmienia wskaźnik, więc map_advance() (wołane raz na obrót
+ * w INT1) widzi zawsze cały stary albo cały nowy komplet.
+ */
+struct map_tables {
+	uint16_t advance[MAP_LOAD_SIZE][MAP_RPM_SIZE]; /* (wyprzedzenie - offset czujnika) / 180° dla aktualnej mapy, stały przecinek 0.16 */
+	uint16_t rpm_half_times[MAP_RPM_SIZE]; /* Czas 1/2 obrotu w punktach osi obrotów (malejąco) */
+	uint16_t rpm_scale[MAP_RPM_SIZE]; /* 65536 / różnica czasów między punktem i a i+1 osi obrotów */
+	uint16_t load_axis[MAP_LOAD_SIZE]; /* Kopia __map_load_axis */
+	uint16_t load_scale[MAP_LOAD_SIZE]; /* 65536 / różnica między punktem i a i+1 osi obciążenia */
+};
+
+static struct map_tables _tables[2];
+static struct map_tables * volatile _live = &_tables[0]; /* Komplet używany przez przerwania */
+
+/* Sprawdzenie czy punkty osi są ściśle rosnące */
+static uint8_t map_axis_valid(uint16_t * axis, uint8_t size, uint16_t max) {
+	uint8_t i;
+	
+	for(i = 1; i < size; i++) {
+		if ((axis[i] <= axis[i - 1]) || (axis[i] > max))
+			return 0;
+	}
+	
+	return 1;
+}
+
+/* Domyślne osie - środki przedziałów starej mapy (co 500 RPM) i równe przedziały przepustnicy */
+static void map_default_axes(void) {
+	uint8_t i;
+	
+	for(i = 0; i < MAP_RPM_SIZE; i++)
+		__map_rpm_axis[i] = 250 + i * 500;
+	
+	for(i = 0; i < MAP_LOAD_SIZE; i++)
+		__map_load_axis[i] = ((uint32_t)i * MAP_LOAD_MAX) / (MAP_LOAD_SIZE - 1);
+}
+
+static uint16_t map_scale(uint16_t delta) {
+	if (delta <= 1)
+		return 0xFFFF;
+	return 65536UL / delta;
+}
+
+static uint16_t map_half_time(uint16_t rpm) {
+	uint32_t tmp;
+	
+	if (!rpm) /* Osie jeszcze nie wczytane */
+		return 0xFFFF;
+	
+	tmp = RPM_TO_HALF_TIME(rpm);
+	return (tmp > 0xFFFF) ? 0xFFFF : tmp;
+}
 
 void map_init(void) {
-	eeprom_busy_wait();
-	eeprom_read_block(__ignition_map, _ee_ignition_map, MAP_COUNT * MAP_RPM_SIZE);
+	storage_load(STORAGE_MAP);
+	storage_load(STORAGE_RPM_AXIS);
+	storage_load(STORAGE_LOAD_AXIS);
+	
+	if ((!__map_rpm_axis[0]) || (!map_axis_valid(__map_rpm_axis, MAP_RPM_SIZE, 0xFFFF)) || (!map_axis_valid(__map_load_axis, MAP_LOAD_SIZE, MAP_LOAD_MAX))) {
+		map_default_axes(); /* Pusty eeprom */
+	}
+	
+	map_update();
 }
 
+/* Zapis mapy do eeprom w tle (storage.c) */
 void map_write(void) {
-	eeprom_busy_wait();
-	eeprom_update_block(__ignition_map, _ee_ignition_map, MAP_COUNT * MAP_RPM_SIZE);
+	storage_save(STORAGE_MAP);
+	map_update();
+}
+
+/* Początek odbioru mapy - kopia bieżącej mapy do bufora odbiorczego */
+void map_stage(void) {
+	memcpy(__map_staging, __ignition_map, sizeof(__ignition_map));
+}
+
+/* CRC16-CCITT odebranej mapy (wszystkie mapy, wiersz po wierszu), do sprawdzenia z CRC z polecenia 'w' */
+uint16_t map_staging_crc(void) {
+	const uint8_t * p = (const uint8_t *)__map_staging;
+	uint16_t crc = 0xFFFF;
+	uint16_t i;
+	
+	for(i = 0; i < sizeof(__map_staging); i++)
+		crc = _crc_ccitt_update(crc, p[i]);
+	
+	return crc;
+}
+
+/*
+ * Zatwierdzenie odebranej mapy i zapis do eeprom, zwraca 0 gdy OK, 2 gdy
+ * wyprzedzenie w którejś komórce przekracza MAP_ADVANCE_MAX (mapa bez zmian).
+ * Przerwania nie czytają __ignition_map, nowa mapa trafia do nich przez
+ * podmianę tablic w map_update().
+ */
+uint8_t map_commit(void) {
+	const uint8_t * p = (const uint8_t *)__map_staging;
+	uint16_t i;
+	
+	for(i = 0; i < sizeof(__map_staging); i++) {
+		if (p[i] > MAP_ADVANCE_MAX)
+			return 0x02;
+	}
+	
+	memcpy(__ignition_map, __map_staging, sizeof(__ignition_map));
+	map_write();
+	return 0x00;
+}
+
+/*
+ * Zmiana kolejnych komórek mapy (wiersz po wierszu, jak w poleceniu 'w') od
+ * podanej komórki, bez zapisu do eeprom (map_save() później). Zwraca 0 gdy OK,
+ * 1 gdy komórki wychodzą poza mapę, 2 gdy wyprzedzenie przekracza MAP_ADVANCE_MAX.
+ */
+uint8_t map_set_cells(uint8_t row, uint8_t col, const uint8_t * values, uint8_t count) {
+	uint16_t first = row * MAP_RPM_SIZE + col;
+	uint8_t i;
+	
+	if ((row >= MAP_ROWS) || (col >= MAP_RPM_SIZE) || (!count) || (first + count > sizeof(__ignition_map)))
+		return 0x01;
+	
+	for(i = 0; i < count; i++) {
+		if (values[i] > MAP_ADVANCE_MAX)
+			return 0x02;
+	}
+	
+	/* Zapis mapy do eeprom (EE_READY) nie może przeczytać części zmian - najwyżej PARSER_CELLS_MAX bajtów */
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		memcpy((uint8_t *)__ignition_map + first, values, count);
+		storage_touch(STORAGE_MAP); /* Trwający zapis mapy do eeprom musi zacząć od nowa */
+	}
+	map_update();
+	return 0x00;
+}
+
+/* Zapis mapy do eeprom w tle (po zmianach przez map_set_cells()) */
+void map_save(void) {
+	storage_save(STORAGE_MAP);
+}
+
+/* Ustawienie i zapis nowych osi mapy, zwraca 0 gdy OK, 1 gdy punkty osi nie są rosnące */
+uint8_t map_set_axes(uint16_t * rpm_axis, uint16_t * load_axis) {
+	if ((!rpm_axis[0]) || (!map_axis_valid(rpm_axis, MAP_RPM_SIZE, 0xFFFF)) || (!map_axis_valid(load_axis, MAP_LOAD_SIZE, MAP_LOAD_MAX))) {
+		return 0x01;
+	}
+	
+	/* Przerwania używają kopii osi z map_update() */
+	memcpy(__map_rpm_axis, rpm_axis, sizeof(__map_rpm_axis));
+	memcpy(__map_load_axis, load_axis, sizeof(__map_load_axis));
+	
+	storage_save(STORAGE_RPM_AXIS);
+	storage_save(STORAGE_LOAD_AXIS);
+	map_update();
+	return 0x00;
+}
+
+/* Przeliczenie tablic używanych w przerwaniach (po zmianie mapy, osi lub parametrów) - nieaktywny komplet, potem podmiana */
+void map_update(void) {
+	struct map_tables * t;
+	uint8_t i, j, map;
+	uint16_t offset, half_time, next;
+	uint32_t tmp;
+	
+	t = (_live == &_tables[0]) ? &_tables[1] : &_tables[0];
+	
+	map = __params[PARAM_CURRENT_MAP];
+	if (map >= MAP_COUNT)
+		map = 0;
+	
+	offset = __params[PARAM_CRANK_OFFSET];
+	
+	for(j = 0; j < MAP_LOAD_SIZE; j++) {
+		for(i = 0; i < MAP_RPM_SIZE; i++) {
+			if (__ignition_map[map][j][i] <= offset) { /* Wyprzedzenie mniejsze niż bazowe - iskra w GMP */
+				tmp = 0;
+			}
+			else {
+				tmp = ((uint32_t)(__ignition_map[map][j][i] - offset) << 16) / 180UL;
+				if (tmp > 0xFFFF)
+					tmp = 0xFFFF;
+			}
+			
+			t->advance[j][i] = tmp;
+		}
+		
+		t->load_axis[j] = __map_load_axis[j];
+		t->load_scale[j] = (j < MAP_LOAD_SIZE - 1) ? map_scale(__map_load_axis[j + 1] - __map_load_axis[j]) : 0;
+	}
+	
+	half_time = map_half_time(__map_rpm_axis[0]);
+	for(i = 0; i < MAP_RPM_SIZE; i++) {
+		if (i < MAP_RPM_SIZE - 1) {
+			next = map_half_time(__map_rpm_axis[i + 1]);
+			tmp = map_scale(half_time - next);
+		}
+		else {
+			next = 0;
+			tmp = 0;
+		}
+		
+		t->rpm_half_times[i] = half_time;
+		t->rpm_scale[i] = tmp;
+		half_time = next;
+	}
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		_live = t;
+	}
+}
+
+/* Numer przedziału osi obrotów dla danego czasu 1/2 obrotu (wyszukiwanie binarne, stały czas) */
+static inline uint8_t map_rpm_bin(const struct map_tables * t, uint16_t half_time) {
+	uint8_t bin = 0;
+	uint8_t step;
+	
+	for(step = MAP_RPM_SIZE / 2; step; step >>= 1) {
+		if (half_time <= t->rpm_half_times[bin + step])
+			bin += step;
+	}
+	
+	return bin;
+}
+
+/* Numer przedziału osi obrotów aktualnych tablic (w przerwaniu, np. dla poprawki w timing.c) */
+uint8_t map_rpm_index(uint16_t half_time) {
+	return map_rpm_bin(_live, half_time);
+}
+
+/*
+ * Wyprzedzenie dla danego czasu 1/2 obrotu i obciążenia jako ułamek 1/2 obrotu
+ * (stały przecinek 0.16), interpolacja dwuliniowa między komórkami aktualnej mapy.
+ * Oś obrotów interpolowana jest liniowo względem czasu 1/2 obrotu.
+ * Stała ilość operacji: 4 porównania osi obrotów, MAP_LOAD_SIZE - 1 porównań
+ * osi obciążenia i 5 mnożeń.
+ */
+uint16_t map_advance(uint16_t half_time, uint16_t load) {
+	const struct map_tables * t = _live;
+	uint8_t i, j, i1, j1;
+	uint16_t w_rpm, w_load;
+	int32_t top, bottom;
+	
+	/* Oś obrotów - waga 0..256 między punktem i a i+1 */
+	i = map_rpm_bin(t, half_time);
+	if (half_time >= t->rpm_half_times[i]) { /* Poniżej pierwszego punktu osi */
+		w_rpm = 0;
+	}
+	else {
+		w_rpm = ((uint32_t)(t->rpm_half_times[i] - half_time) * t->rpm_scale[i]) >> 8;
+		if (w_rpm > 256)
+			w_rpm = 256;
+	}
+	i1 = (i < MAP_RPM_SIZE - 1) ? i + 1 : i;
+	
+	/* Oś obciążenia */
+	j = 0;
+	for(j1 = 1; j1 < MAP_LOAD_SIZE; j1++) {
+		if (load >= t->load_axis[j1])
+			j = j1;
+	}
+	
+	if (load <= t->load_axis[j]) {
+		w_load = 0;
+	}
+	else {
+		w_load = ((uint32_t)(load - t->load_axis[j]) * t->load_scale[j]) >> 8;
+		if (w_load > 256)
+			w_load = 256;
+	}
+	j1 = (j < MAP_LOAD_SIZE - 1) ? j + 1 : j;
+	
+	top = t->advance[j][i] + ((((int32_t)t->advance[j][i1] - t->advance[j][i]) * w_rpm) >> 8);
+	bottom = t->advance[j1][i] + ((((int32_t)t->advance[j1][i1] - t->advance[j1][i]) * w_rpm) >> 8);
+	
+	return top + (((bottom - top) * w_load) >> 8);
 }
@@ -3,12 +3,32 @@
 
 #include <stdint.h>
 
-#define MAP_RPM_SIZE          16
+#define MAP_RPM_SIZE          16 /* Ilość punktów osi obrotów */
+#define MAP_LOAD_SIZE         4  /* Ilość punktów osi obciążenia (położenia przepustnicy) */
 #define MAP_COUNT             4  /* Ilość map zapisanych w pamięci */
+#define MAP_ROWS              (MAP_COUNT * MAP_LOAD_SIZE) /* Ilość wierszy wszystkich map (mapa, obciążenie) */
 
-extern uint8_t __ignition_map[MAP_COUNT][MAP_RPM_SIZE];
+#define MAP_LOAD_MAX          1023 /* Maksymalny odczyt przepustnicy (ADC 10 bit) */
+#define MAP_ADVANCE_MAX       90   /* Maksymalne wyprzedzenie w komórce mapy [°] */
+
+/* Czas 1/2 obrotu (tyknięcia timera, preskaler 64) odpowiadający danym obrotom */
+#define RPM_TO_HALF_TIME(rpm) ((30UL * (F_CPU / 64)) / (rpm))
+
+extern uint8_t __ignition_map[MAP_COUNT][MAP_LOAD_SIZE][MAP_RPM_SIZE];
+extern uint8_t __map_staging[MAP_COUNT][MAP_LOAD_SIZE][MAP_RPM_SIZE];
+extern uint16_t __map_rpm_axis[MAP_RPM_SIZE];
+extern uint16_t __map_load_axis[MAP_LOAD_SIZE];
 
 void map_init(void);
 void map_write(void);
+void map_stage(void);
+uint16_t map_staging_crc(void);
+uint8_t map_commit(void);
+uint8_t map_set_cells(uint8_t row, uint8_t col, const uint8_t * values, uint8_t count);
+void map_save(void);
+uint8_t map_set_axes(uint16_t * rpm_axis, uint16_t * load_axis);
+void map_update(void);
+uint16_t map_advance(uint16_t half_time, uint16_t load);
+uint8_t map_rpm_index(uint16_t half_time);
 
 #endif /* __MAP_H */
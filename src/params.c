@@ -1,16 +1,71 @@
-#include <avr/eeprom.h>
+#include <util/atomic.h>
 #include "params.h" 
+#include "map.h"
+#include "storage.h"
 
 uint16_t __params[PARAM_COUNT];
-static uint16_t _ee_params[PARAM_COUNT] EEMEM; /* Mapa zapisana w eeprom */
+uint16_t __params_half_time[PARAM_RPM_COUNT]; /* Progi obrotów przeliczone na czas 1/2 obrotu */
+uint16_t __params_dwell_ticks; /* Czas ładowania cewki w tyknięciach timera 1 */
+struct params_limit __params_limit;
 
+/* Czas 1/2 obrotu dla obrotów (w zakresie 16 bitów, 0 obr/min - najdłuższy) */
+static uint16_t params_half_time(uint16_t rpm) {
+	uint32_t tmp = rpm ? RPM_TO_HALF_TIME(rpm) : 0xFFFF;
+	return (tmp > 0xFFFF) ? 0xFFFF : tmp;
+}
+
+/* Progi ogranicznika obrotów i odwrotności szerokości stref (przerwanie tylko mnoży) */
+static void params_update_limit(void) {
+	struct params_limit limit = { 0, 0, 0, 0 };
+	uint16_t start = __params[PARAM_IGN_CUT_OFF_START], window = __params[PARAM_LIMIT_WINDOW];
+	
+	if ((window) && (start > window) && (start <= UINT16_MAX - window)) {
+		limit.soft = params_half_time(start - window);
+		limit.hard = params_half_time(start + window);
+		
+		/* Zbyt wąska strefa (mniej niż tyknięcie) - jak twarde odcięcie */
+		if ((limit.soft > __params_half_time[PARAM_IGN_CUT_OFF_START]) && (limit.hard < __params_half_time[PARAM_IGN_CUT_OFF_START])) {
+			limit.retard_scale = 0xFFFFUL / (limit.soft - __params_half_time[PARAM_IGN_CUT_OFF_START]);
+			limit.skip_scale = 0xFFFFUL / (__params_half_time[PARAM_IGN_CUT_OFF_START] - limit.hard);
+		}
+		else {
+			limit.soft = 0;
+		}
+	}
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		__params_limit = limit;
+	}
+}
+
+/* Przeliczenie progów obrotów na czasy 1/2 obrotu, aby przerwania nie musiały dzielić */
+static void params_update(void) {
+	uint8_t i;
+	uint16_t tmp;
+	
+	for(i = 0; i < PARAM_RPM_COUNT; i++) {
+		tmp = params_half_time(__params[i]);
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			__params_half_time[i] = tmp;
+		}
+	}
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		__params_dwell_ticks = __params[PARAM_DWELL_TIME] / (1000000UL / (F_CPU / 64));
+	}
+	
+	params_update_limit();
+	
+	map_update(); /* Offset czujnika i numer mapy wpływają na tablicę wyprzedzeń */
+}
 
 void params_init(void) {
-	eeprom_busy_wait();
-	eeprom_read_block(__params, _ee_params, sizeof(uint16_t) * PARAM_COUNT);
+	storage_load(STORAGE_PARAMS);
+	params_update();
 }
 
+/* Zapis do eeprom w tle (storage.c) */
 void params_save(void) {
-	eeprom_busy_wait();
-	eeprom_update_block(__params, _ee_params, sizeof(uint16_t) * PARAM_COUNT);
+	storage_save(STORAGE_PARAMS);
+	params_update();
 }
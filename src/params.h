@@ -10,9 +10,30 @@
 #define PARAM_CURRENT_MAP        4
 #define PARAM_IMMO_ENABLED       5
 #define PARAM_CRANK_OFFSET       6
-#define PARAM_COUNT              7
+#define PARAM_DWELL_TIME         7 /* Czas ładowania cewki przed iskrą [µs], 0 - cewka włączana w DMP */
+#define PARAM_LIMIT_WINDOW       8 /* Szerokość progresywnego ogranicznika obrotów [obr/min], 0 - odcięcie z histerezą */
+#define PARAM_COUNT              9
+
+#define PARAM_RPM_COUNT          4 /* Parametry 0..3 to obroty silnika */
 
 extern uint16_t __params[PARAM_COUNT];
+extern uint16_t __params_half_time[PARAM_RPM_COUNT];
+extern uint16_t __params_dwell_ticks;
+
+/*
+ * Progresywny ogranicznik obrotów przeliczony na czasy 1/2 obrotu. Od
+ * PARAM_IGN_CUT_OFF_START - okno wyprzedzenie jest cofane liniowo do zera
+ * (iskra w GMP) przy PARAM_IGN_CUT_OFF_START, dalej pomijana jest coraz
+ * większa część iskier, aż do wszystkich przy PARAM_IGN_CUT_OFF_START + okno.
+ */
+struct params_limit {
+	uint16_t soft; /* Początek cofania wyprzedzenia (0 - ogranicznik wyłączony) */
+	uint16_t hard; /* Wszystkie iskry pomijane */
+	uint16_t retard_scale; /* (2^16 - 1) / (soft - PARAM_IGN_CUT_OFF_START) - współczynnik wyprzedzenia 0.8 */
+	uint16_t skip_scale; /* (2^16 - 1) / (PARAM_IGN_CUT_OFF_START - hard) - gęstość pomijania 0.8 */
+};
+
+extern struct params_limit __params_limit;
 
 void params_init(void);
 void params_save(void);
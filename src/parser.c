@@ -0,0 +1,157 @@
+#include <stdint.h>
+#include <string.h>
+#include "parser.h"
+#include "map.h"
+#include "immo.h"
+#include "params.h"
+
+/* Wartość cyfry hex (niepoprawne znaki jak 0, tak jak wcześniej hex2int8) */
+static inline uint8_t parser_hex(uint8_t c) {
+	if ((c >= '0') && (c <= '9'))
+		return c - '0';
+	
+	c |= 0x20; /* Małe litery */
+	if ((c >= 'a') && (c <= 'f'))
+		return c - 'a' + 10;
+	
+	return 0;
+}
+
+/* Ilość cyfr hex przyjmowanych przez polecenie (nadmiarowe są pomijane) */
+static inline uint8_t parser_max_digits(uint8_t cmd) {
+	switch(cmd) {
+		case 'e':
+		case 'g':
+		case 't': return 2;
+		case 'l':
+		case 'G': return 4;
+		case 's': return 6;
+		case 'S': return PARSER_PARAMS_DIGITS;
+		case 'c': return PARSER_CELLS_DIGITS;
+		case 'y': return PARSER_AXES_DIGITS;
+	}
+	
+	return 0;
+}
+
+void parser_reset(struct parser * p) {
+	p->cmd = 0;
+	p->error = 0;
+	p->digits = 0;
+	p->value = 0;
+	p->row = 0;
+	p->col = 0;
+}
+
+/* Pierwszy znak polecenia - przygotowanie miejsca na argumenty */
+static void parser_begin(struct parser * p, uint8_t c) {
+	p->cmd = c;
+	
+	if (c == 'w') { /* Komórki, których nie ma w poleceniu zostają bez zmian */
+		map_stage();
+	}
+	else if (c == 'i') {
+		memcpy(p->args.keys, __immo_keys, sizeof(p->args.keys));
+	}
+}
+
+/* Komórki mapy - pary cyfr hex, wiersze rozdzielone ';', opcjonalnie '#' i CRC mapy */
+static void parser_map(struct parser * p, uint8_t c) {
+	if (p->row == PARSER_MAP_CRC) {
+		if (p->digits >= 4) { /* CRC ma 4 cyfry */
+			p->error = 0x01;
+			return;
+		}
+		p->value = (p->value << 4) | parser_hex(c);
+		p->digits++;
+	}
+	else if (c == '#') {
+		p->row = PARSER_MAP_CRC;
+		p->digits = 0;
+		p->value = 0;
+	}
+	else if (c == ';') { /* Następny wiersz (licznik zatrzymuje się za mapą, aby się nie przekręcił) */
+		if (p->row <= MAP_ROWS)
+			p->row++;
+		p->col = 0;
+		p->digits = 0;
+	}
+	else if (!(p->digits++ & 1)) { /* Pierwsza cyfra komórki */
+		if ((p->row >= MAP_ROWS) || (p->col >= MAP_RPM_SIZE)) { /* Mapa za duża, coś skopane */
+			p->error = 0x01;
+			return;
+		}
+		p->value = parser_hex(c) << 4;
+	}
+	else {
+		__map_staging[p->row / MAP_LOAD_SIZE][p->row % MAP_LOAD_SIZE][p->col++] = p->value | parser_hex(c);
+	}
+}
+
+/* Klucze immobilizera rozdzielone spacją */
+static void parser_keys(struct parser * p, uint8_t c) {
+	if (p->row >= IMMO_KEYS)
+		return;
+	
+	if ((c == ' ') || (c == '\0') || (p->col >= IMMO_KEY_LEN)) { /* Następny klucz */
+		p->row++;
+		p->col = 0;
+	}
+	else {
+		p->args.keys[p->row][p->col++] = c;
+	}
+}
+
+/* Odebranie znaku, zwraca 1 gdy polecenie jest kompletne (do wykonania) */
+uint8_t parser_feed(struct parser * p, uint8_t c) {
+	if (c == '\n') /* \n pomijamy */
+		return 0;
+	
+	if (c == '\r') { /* Koniec polecenia */
+		if ((p->cmd == 's') && (p->digits != parser_max_digits(p->cmd))) /* Tylko pełne 2 + 4 cyfry */
+			p->error = 0x01;
+		return 1;
+	}
+	
+	if (!p->cmd) {
+		parser_begin(p, c);
+		return 0;
+	}
+	
+	if (p->error)
+		return 0;
+	
+	if (p->cmd == 'w') {
+		parser_map(p, c);
+	}
+	else if (p->cmd == 'i') {
+		parser_keys(p, c);
+	}
+	else if (p->digits < parser_max_digits(p->cmd)) {
+		p->value = (p->value << 4) | parser_hex(c);
+		p->digits++;
+		
+		if (((p->cmd == 's') || (p->cmd == 'S')) && (p->digits == 2)) { /* Numer parametru, dalej wartość (wartości) */
+			p->row = p->value;
+		}
+		else if ((p->cmd == 'S') && (!((p->digits - 2) & 3))) {
+			p->args.params[((p->digits - 2) >> 2) - 1] = p->value;
+		}
+		else if (p->cmd == 'c') { /* Wiersz, kolumna, dalej wartości komórek */
+			if (p->digits == 2)
+				p->row = p->value;
+			else if (p->digits == 4)
+				p->col = p->value;
+			else if (!(p->digits & 1))
+				p->args.cells[((p->digits - 4) >> 1) - 1] = p->value;
+		}
+		else if ((p->cmd == 'y') && (!(p->digits & 3))) {
+			p->args.axes[(p->digits >> 2) - 1] = p->value;
+		}
+	}
+	else if ((p->cmd == 's') || (p->cmd == 'S') || (p->cmd == 'c')) { /* Więcej wartości niż miejsca - nie zapisujemy części z nich po cichu */
+		p->error = 0x01;
+	}
+	
+	return 0;
+}
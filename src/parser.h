@@ -0,0 +1,40 @@
+#ifndef __PARSER_H
+#define __PARSER_H
+
+#include <stdint.h>
+#include "map.h"
+#include "immo.h"
+#include "params.h"
+
+/*
+ * Parser poleceń interfejsu dekodujący polecenie znak po znaku, bez
+ * bufora na całą linię. Argumenty hex zamieniane są na liczby w trakcie
+ * odbioru, komórki mapy ('w') trafiają od razu do __map_staging, klucze
+ * ('i'), osie mapy ('y') i parametry ('S') do args. Polecenie wykonywane jest po '\r'.
+ */
+
+#define PARSER_AXES_DIGITS      (4 * (MAP_RPM_SIZE + MAP_LOAD_SIZE)) /* Ilość cyfr hex polecenia 'y' */
+#define PARSER_MAP_CRC          0xFF /* 'w' - wiersz po '#', dalej CRC mapy (4 cyfry hex) */
+#define PARSER_CELLS_MAX        MAP_RPM_SIZE /* Maksymalna ilość komórek w poleceniu 'c' */
+#define PARSER_CELLS_DIGITS     (4 + 2 * PARSER_CELLS_MAX) /* Ilość cyfr hex polecenia 'c' (wiersz, kolumna + wartości) */
+#define PARSER_PARAMS_DIGITS    (2 + 4 * PARAM_COUNT) /* Ilość cyfr hex polecenia 'S' (pierwszy parametr + wartości) */
+
+struct parser {
+	uint8_t cmd; /* Polecenie (pierwszy znak linii), 0 - jeszcze nie odebrane */
+	uint8_t error; /* Błąd wykryty w trakcie odbioru, polecenie nie zostanie wykonane */
+	uint16_t digits; /* Ilość odebranych cyfr hex */
+	uint16_t value; /* Ostatnie (najwyżej 4) odebrane cyfry hex */
+	uint8_t row; /* 'w'/'c' - wiersz mapy (PARSER_MAP_CRC - CRC), 'i' - numer klucza, 's'/'S' - numer (pierwszego) parametru */
+	uint8_t col; /* 'w'/'c' - kolumna mapy, 'i' - znak klucza */
+	union {
+		uint16_t axes[MAP_RPM_SIZE + MAP_LOAD_SIZE]; /* 'y' - oś obrotów, oś obciążenia */
+		uint8_t keys[IMMO_KEYS][IMMO_KEY_LEN + 1]; /* 'i' - klucze immobilizera */
+		uint16_t params[PARAM_COUNT]; /* 'S' - wartości kolejnych parametrów */
+		uint8_t cells[PARSER_CELLS_MAX]; /* 'c' - wartości kolejnych komórek mapy */
+	} args;
+};
+
+void parser_reset(struct parser * p);
+uint8_t parser_feed(struct parser * p, uint8_t c);
+
+#endif /* __PARSER_H */
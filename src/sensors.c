@@ -0,0 +1,118 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdint.h>
+#include "sensors.h"
+
+/*
+ * Odczyt ADC w przerwaniach: kanały ADC8 (temperatura) i ADC9 (przepustnica)
+ * mierzone są na zmianę, po zmianie kanału (i napięcia odniesienia) pierwsza
+ * konwersja jest odrzucana. Wyniki są filtrowane i publikowane w podwójnym
+ * buforze - ADC_vect zapisuje nieaktywny bufor i zmienia __sensors_active,
+ * więc odczyt nigdy nie czeka na przetwornik.
+ */
+
+#ifndef SENSORS_CRANK_SYNC
+#define SENSORS_CRANK_SYNC      0 /* 1 - pomiar uruchamiany w GMP (stałe położenie wału) zamiast ciągłego */
+#endif
+
+#define SENSORS_FILTER_SHIFT    2 /* Filtr wykładniczy, stała czasowa 2^SENSORS_FILTER_SHIFT pomiarów */
+
+/* Prescaler 64 - 125 kHz przy 8 MHz */
+#define SENSORS_ADCSRA          ((1 << ADEN) | (1 << ADIE) | (1 << ADIF) | (1 << ADPS2) | (1 << ADPS1))
+
+uint16_t __sensors_raw[2][SENSOR_COUNT]; /* Przefiltrowane odczyty ADC, aktywny bufor wskazuje __sensors_active */
+volatile uint8_t __sensors_active;
+
+static volatile uint8_t _seq; /* Zwiększany przy każdej publikacji */
+static uint16_t _filtered[SENSOR_COUNT]; /* Przesunięte o SENSORS_FILTER_SHIFT bitów */
+static uint8_t _channel;
+static uint8_t _discard; /* Pierwszy pomiar po zmianie kanału jest odrzucany */
+static uint8_t _started; /* Pierwszy pomiar kanału inicjalizuje filtr */
+static volatile uint8_t _busy;
+
+static inline void sensors_select(uint8_t channel) {
+	if (channel == SENSOR_TEMP) { /* AREF = wewnętrzne 2.56V, kanał 8 */
+		ADMUX = (1 << REFS0) | (1 << REFS1);
+		ADCSRB = (1 << MUX5);
+	}
+	else { /* AREF = AVcc, kanał 9 */
+		ADMUX = (1 << REFS0) | (1 << MUX0);
+		ADCSRB = (1 << ADHSM) | (1 << MUX5);
+	}
+}
+
+static inline void sensors_start(void) {
+	ADCSRA = SENSORS_ADCSRA | (1 << ADSC);
+}
+
+ISR(ADC_vect) {
+	uint16_t value = ADC;
+	uint8_t next;
+	
+	if (_discard) {
+		_discard = 0;
+		sensors_start();
+		return;
+	}
+	
+	if (_started & (1 << _channel)) {
+		_filtered[_channel] -= _filtered[_channel] >> SENSORS_FILTER_SHIFT;
+		_filtered[_channel] += value;
+	}
+	else {
+		_filtered[_channel] = value << SENSORS_FILTER_SHIFT;
+		_started |= (1 << _channel);
+	}
+	
+	/* Publikacja wyników - zapis do nieaktywnego bufora, potem przełączenie */
+	next = __sensors_active ^ 1;
+	__sensors_raw[next][SENSOR_TEMP] = _filtered[SENSOR_TEMP] >> SENSORS_FILTER_SHIFT;
+	__sensors_raw[next][SENSOR_THROTTLE] = _filtered[SENSOR_THROTTLE] >> SENSORS_FILTER_SHIFT;
+	__sensors_active = next;
+	_seq++;
+	
+	/* Następny kanał */
+	_channel = (_channel + 1) % SENSOR_COUNT;
+	sensors_select(_channel);
+	_discard = 1;
+	
+	if ((SENSORS_CRANK_SYNC) && (_channel == 0)) { /* Koniec serii, czekamy na GMP */
+		_busy = 0;
+		return;
+	}
+	
+	sensors_start();
+}
+
+void sensors_init(void) {
+	_channel = 0;
+	_discard = 1;
+	_busy = 1;
+	sensors_select(_channel);
+	sensors_start();
+}
+
+/* Odczyt spójnej kopii wyników (bez blokowania przerwań) */
+void sensors_read(struct sensors_data * data) {
+	uint16_t raw[SENSOR_COUNT];
+	uint8_t seq, active;
+	
+	do {
+		seq = _seq;
+		active = __sensors_active;
+		raw[SENSOR_TEMP] = __sensors_raw[active][SENSOR_TEMP];
+		raw[SENSOR_THROTTLE] = __sensors_raw[active][SENSOR_THROTTLE];
+	} while (seq != _seq);
+	
+	data->throttle = raw[SENSOR_THROTTLE];
+	data->temp = ((raw[SENSOR_TEMP] * 380UL) / 1024UL) - 80;
+}
+
+/* Wywoływane w GMP - w trybie synchronizacji z wałem uruchamia serię pomiarów */
+void sensors_crank_sync(void) {
+	if ((!SENSORS_CRANK_SYNC) || (_busy))
+		return;
+	
+	_busy = 1;
+	sensors_start();
+}
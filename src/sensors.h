@@ -0,0 +1,28 @@
+#ifndef __SENSORS_H
+#define __SENSORS_H
+
+#include <stdint.h>
+
+#define SENSOR_TEMP             0 /* ADC8 */
+#define SENSOR_THROTTLE         1 /* ADC9 */
+#define SENSOR_COUNT            2
+
+/* Odczyty czujników analogowych (po filtracji) */
+struct sensors_data {
+	uint16_t throttle; /* Położenie przepustnicy (0..1023) */
+	int16_t temp; /* Temperatura silnika [°C] */
+};
+
+extern uint16_t __sensors_raw[2][SENSOR_COUNT];
+extern volatile uint8_t __sensors_active;
+
+void sensors_init(void);
+void sensors_read(struct sensors_data * data);
+void sensors_crank_sync(void);
+
+/* Położenie przepustnicy do użycia w przerwaniach (ADC_vect nie przerwie innego przerwania) */
+static inline uint16_t sensors_throttle(void) {
+	return __sensors_raw[__sensors_active][SENSOR_THROTTLE];
+}
+
+#endif /* __SENSORS_H */
@@ -0,0 +1,206 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
+#include <stdint.h>
+#include "storage.h"
+#include "params.h"
+#include "map.h"
+#include "immo.h"
+
+#define STORAGE_IDLE            0xFF
+#define EE_ADDR(addr)           ((uint8_t *)(uintptr_t)(addr))
+
+/* Ilość slotów obszarów (częściej zmieniane, małe obszary mają ich więcej) */
+#define STORAGE_PARAMS_SLOTS    8
+#define STORAGE_MAP_SLOTS       2
+#define STORAGE_RPM_AXIS_SLOTS  2
+#define STORAGE_LOAD_AXIS_SLOTS 4
+#define STORAGE_IMMO_SLOTS      2
+
+/* Układ eeprom - obszary jeden za drugim, każdy to slots * (nagłówek + dane) */
+#define STORAGE_SLOT_SIZE(data) (sizeof(data) + STORAGE_HEADER)
+#define EE_PARAMS               0
+#define EE_MAP                  (EE_PARAMS + STORAGE_PARAMS_SLOTS * STORAGE_SLOT_SIZE(__params))
+#define EE_RPM_AXIS             (EE_MAP + STORAGE_MAP_SLOTS * STORAGE_SLOT_SIZE(__ignition_map))
+#define EE_LOAD_AXIS            (EE_RPM_AXIS + STORAGE_RPM_AXIS_SLOTS * STORAGE_SLOT_SIZE(__map_rpm_axis))
+#define EE_IMMO                 (EE_LOAD_AXIS + STORAGE_LOAD_AXIS_SLOTS * STORAGE_SLOT_SIZE(__map_load_axis))
+#define EE_END                  (EE_IMMO + STORAGE_IMMO_SLOTS * STORAGE_SLOT_SIZE(__immo_keys))
+
+typedef char storage_layout_fits[(EE_END <= E2END + 1) ? 1 : -1];
+
+/*
+ * Slot w eeprom:
+ * [0]    numer wersji (zapisywany jako ostatni)
+ * [1..2] CRC16-CCITT numeru obszaru, numeru wersji i danych
+ * [3..]  dane
+ */
+struct storage_region {
+	void * data;
+	uint16_t size;
+	uint16_t base; /* Adres pierwszego slotu */
+	uint8_t slots;
+};
+
+static const struct storage_region _regions[STORAGE_REGIONS] = {
+	[STORAGE_PARAMS]    = { __params, sizeof(__params), EE_PARAMS, STORAGE_PARAMS_SLOTS },
+	[STORAGE_MAP]       = { __ignition_map, sizeof(__ignition_map), EE_MAP, STORAGE_MAP_SLOTS },
+	[STORAGE_RPM_AXIS]  = { __map_rpm_axis, sizeof(__map_rpm_axis), EE_RPM_AXIS, STORAGE_RPM_AXIS_SLOTS },
+	[STORAGE_LOAD_AXIS] = { __map_load_axis, sizeof(__map_load_axis), EE_LOAD_AXIS, STORAGE_LOAD_AXIS_SLOTS },
+	[STORAGE_IMMO]      = { __immo_keys, sizeof(__immo_keys), EE_IMMO, STORAGE_IMMO_SLOTS },
+};
+
+static uint8_t _active[STORAGE_REGIONS]; /* Slot z aktualną wersją obszaru */
+static uint8_t _version[STORAGE_REGIONS]; /* Numer aktualnej wersji obszaru */
+static volatile uint8_t _dirty; /* Obszary do zapisania (bity) */
+
+/* Stan zapisu (w przerwaniu, storage_touch() tylko czyta _region) */
+static uint8_t _region = STORAGE_IDLE;
+static uint8_t _slot;
+static uint8_t _new_version;
+static uint16_t _pos;
+static uint16_t _crc;
+
+static inline uint16_t storage_slot_addr(const struct storage_region * r, uint8_t slot) {
+	return r->base + slot * (r->size + STORAGE_HEADER);
+}
+
+static inline uint16_t storage_crc_start(uint8_t region, uint8_t version) {
+	return _crc_ccitt_update(_crc_ccitt_update(0xFFFF, region), version);
+}
+
+void storage_init(void) {
+	EECR &= ~(1 << EERIE);
+	_dirty = 0;
+	_region = STORAGE_IDLE;
+}
+
+/* Wczytanie najnowszej poprawnej wersji obszaru, zwraca 0 gdy żaden slot nie jest poprawny (dane bez zmian) */
+uint8_t storage_load(uint8_t region) {
+	const struct storage_region * r = &_regions[region];
+	uint16_t addr, crc, i;
+	uint8_t slot, version, found = 0;
+
+	eeprom_busy_wait();
+
+	for(slot = 0; slot < r->slots; slot++) {
+		addr = storage_slot_addr(r, slot);
+		version = eeprom_read_byte(EE_ADDR(addr));
+
+		crc = storage_crc_start(region, version);
+		for(i = 0; i < r->size; i++)
+			crc = _crc_ccitt_update(crc, eeprom_read_byte(EE_ADDR(addr + STORAGE_HEADER + i)));
+
+		if (crc != eeprom_read_word((uint16_t *)EE_ADDR(addr + 1)))
+			continue;
+
+		if ((!found) || ((int8_t)(version - _version[region]) > 0)) { /* Numer wersji się przekręca */
+			found = 1;
+			_active[region] = slot;
+			_version[region] = version;
+		}
+	}
+
+	if (!found) { /* Pusty eeprom - pierwszy zapis do slotu 0 */
+		_active[region] = r->slots - 1;
+		_version[region] = 0;
+		return 0;
+	}
+
+	eeprom_read_block(r->data, EE_ADDR(storage_slot_addr(r, _active[region]) + STORAGE_HEADER), r->size);
+	return 1;
+}
+
+/* Zlecenie zapisu obszaru (po zmianie danych w RAM), zapis wykonywany jest w tle */
+void storage_save(uint8_t region) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		_dirty |= (1 << region);
+		EECR |= (1 << EERIE);
+	}
+}
+
+/*
+ * Dane obszaru zmieniły się, ale zapis może poczekać - jeżeli obszar jest
+ * właśnie zapisywany, zapis zaczyna się od nowa (inaczej w eeprom zostałaby
+ * poprawna wersja z częścią zmian).
+ */
+void storage_touch(uint8_t region) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (_region == region)
+			_dirty |= (1 << region);
+	}
+}
+
+/* Zwraca 1 gdy zapis jest w toku */
+uint8_t storage_busy(void) {
+	return (EECR & (1 << EERIE)) ? 1 : 0;
+}
+
+/* Początek zapisu obszaru do następnego slotu (także ponownie, gdy dane zmieniły się w trakcie zapisu) */
+static void storage_begin(uint8_t region) {
+	_dirty &= ~(1 << region);
+	_region = region;
+	_slot = (_active[region] + 1) % _regions[region].slots;
+	_new_version = _version[region] + 1;
+	_pos = 0;
+	_crc = storage_crc_start(region, _new_version);
+}
+
+/*
+ * Eeprom gotowy - zapis następnego zmienionego bajtu. Kolejność: dane, CRC,
+ * numer wersji. Niezmienione bajty są pomijane (najwyżej STORAGE_SKIP_MAX
+ * w jednym przerwaniu, aby nie opóźniać przerwań czujnika wału), przy braku
+ * zapisu przerwanie wywoła się ponownie od razu.
+ */
+ISR(EE_READY_vect) {
+	const struct storage_region * r;
+	uint16_t addr;
+	uint8_t skip, value;
+
+	for(skip = 0; skip < STORAGE_SKIP_MAX; skip++) {
+		if ((_region != STORAGE_IDLE) && (_dirty & (1 << _region))) {
+			storage_begin(_region);
+		}
+		else if (_region == STORAGE_IDLE) {
+			if (!_dirty) { /* Wszystko zapisane */
+				EECR &= ~(1 << EERIE);
+				return;
+			}
+
+			for(value = 0; !(_dirty & (1 << value)); value++);
+			storage_begin(value);
+		}
+
+		r = &_regions[_region];
+		addr = storage_slot_addr(r, _slot);
+
+		if (_pos < r->size) {
+			value = ((uint8_t *)r->data)[_pos];
+			_crc = _crc_ccitt_update(_crc, value);
+			addr += STORAGE_HEADER + _pos;
+		}
+		else if (_pos == r->size) {
+			value = _crc & 0xFF;
+			addr += 1;
+		}
+		else if (_pos == r->size + 1) {
+			value = _crc >> 8;
+			addr += 2;
+		}
+		else {
+			value = _new_version;
+		}
+
+		if (++_pos == r->size + STORAGE_HEADER) { /* Ostatni bajt nagłówka - nowa wersja staje się aktualna */
+			_active[_region] = _slot;
+			_version[_region] = _new_version;
+			_region = STORAGE_IDLE;
+		}
+
+		if (eeprom_read_byte(EE_ADDR(addr)) != value) {
+			eeprom_write_byte(EE_ADDR(addr), value);
+			return;
+		}
+	}
+}
@@ -0,0 +1,32 @@
+#ifndef __STORAGE_H
+#define __STORAGE_H
+
+#include <stdint.h>
+
+/*
+ * Zapis konfiguracji do eeprom w tle. Każdy obszar (parametry, mapa, osie,
+ * klucze immo) ma w eeprom kilka slotów zapisywanych po kolei (rozłożenie
+ * zużycia komórek). Slot to nagłówek (numer wersji, CRC) i dane - nowa wersja
+ * trafia zawsze do innego slotu niż aktualna, a nagłówek zapisywany jest na
+ * końcu, więc zanik zasilania w trakcie zapisu zostawia poprzednią wersję.
+ * Zapis wykonuje przerwanie EE_READY, bajt po bajcie, pomijając bajty, które
+ * się nie zmieniły.
+ */
+
+#define STORAGE_PARAMS          0
+#define STORAGE_MAP             1
+#define STORAGE_RPM_AXIS        2
+#define STORAGE_LOAD_AXIS       3
+#define STORAGE_IMMO            4
+#define STORAGE_REGIONS         5
+
+#define STORAGE_HEADER          3 /* Numer wersji (1 bajt) + CRC (2 bajty) */
+#define STORAGE_SKIP_MAX        8 /* Ilość niezmienionych bajtów sprawdzanych w jednym przerwaniu */
+
+void storage_init(void);
+uint8_t storage_load(uint8_t region);
+void storage_save(uint8_t region);
+void storage_touch(uint8_t region);
+uint8_t storage_busy(void);
+
+#endif /* __STORAGE_H */
@@ -0,0 +1,81 @@
+#include <util/atomic.h>
+#include <stdint.h>
+#include <string.h>
+#include "timing.h"
+
+int16_t __timing_offsets[MAP_RPM_SIZE];
+static struct timing_stats _stats;
+static uint8_t _learn = TIMING_LEARN;
+
+/* Zerowanie statystyk (poprawka zostaje) */
+void timing_reset(void) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		memset(&_stats, 0, sizeof(_stats));
+		_stats.min = INT16_MAX;
+		_stats.max = INT16_MIN;
+	}
+}
+
+/* Włączenie / wyłączenie uczenia poprawki, wyłączenie zeruje poprawkę (zostaje sama korekta o czas przerwania) */
+void timing_set_learn(uint8_t enabled) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		_learn = enabled;
+		if (!enabled)
+			memset(__timing_offsets, 0, sizeof(__timing_offsets));
+	}
+}
+
+/* Kopia statystyk i poprawki dla interfejsu */
+void timing_read(struct timing_stats * stats, int16_t * offsets) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		*stats = _stats;
+		memcpy(offsets, __timing_offsets, sizeof(__timing_offsets));
+	}
+}
+
+/* Błąd kąta iskry z mijającego obrotu [1/8°] (w przerwaniu INT1) */
+void timing_record(int16_t error) {
+	uint8_t i;
+	int16_t bin;
+	
+	if (_stats.count == UINT16_MAX) { /* Starsze obroty z mniejszą wagą, średnia się nie zmienia */
+		_stats.count >>= 1;
+		_stats.sum >>= 1;
+		for(i = 0; i < TIMING_HIST_BINS; i++)
+			_stats.histogram[i] >>= 1;
+	}
+	
+	_stats.count++;
+	_stats.sum += error;
+	if (error < _stats.min)
+		_stats.min = error;
+	if (error > _stats.max)
+		_stats.max = error;
+	
+	bin = (error >> TIMING_HIST_SHIFT) + TIMING_HIST_BINS / 2;
+	if (bin < 0)
+		bin = 0;
+	else if (bin >= TIMING_HIST_BINS)
+		bin = TIMING_HIST_BINS - 1;
+	_stats.histogram[bin]++;
+}
+
+/*
+ * Spóźnienie iskry względem czasu ustawionego w DMP [tyknięcia] (w przerwaniu
+ * INT1). Poprawka przedziału rośnie o 1/16 spóźnienia na obrót, więc po
+ * kilkudziesięciu obrotach spóźnienie w danym przedziale dąży do zera.
+ */
+void timing_learn(uint8_t bin, int16_t delay) {
+	int16_t offset;
+	
+	if ((!_learn) || (delay > TIMING_LEARN_MAX) || (delay < -TIMING_LEARN_MAX))
+		return;
+	
+	offset = __timing_offsets[bin] + delay;
+	if (offset > (TIMING_OFFSET_MAX << TIMING_OFFSET_SHIFT))
+		offset = TIMING_OFFSET_MAX << TIMING_OFFSET_SHIFT;
+	else if (offset < -(TIMING_OFFSET_MAX << TIMING_OFFSET_SHIFT))
+		offset = -(TIMING_OFFSET_MAX << TIMING_OFFSET_SHIFT);
+	
+	__timing_offsets[bin] = offset;
+}
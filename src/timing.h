@@ -0,0 +1,48 @@
+#ifndef __TIMING_H
+#define __TIMING_H
+
+#include <stdint.h>
+#include "map.h"
+
+/*
+ * Sprawdzanie kąta iskry w zamkniętej pętli. W GMP wyprzedzenie zrealizowane
+ * w mijającym obrocie (wyłączenie cewki względem DMP) porównywane jest
+ * z wyprzedzeniem zadanym z mapy dla tej iskry, błąd trafia do statystyk
+ * (min / max / średnia / histogram). Osobno liczone jest spóźnienie iskry
+ * względem czasu ustawionego w OCR1A (obsługa przerwań) - z niego uczona
+ * jest poprawka czasu iskry dla każdego przedziału osi obrotów.
+ */
+
+#define TIMING_ERROR_SHIFT      3  /* Błąd kąta w 1/8° */
+#define TIMING_HIST_BINS        16 /* Przedziały histogramu błędu, skrajne zbierają też wszystko poza zakresem */
+#define TIMING_HIST_SHIFT       TIMING_ERROR_SHIFT /* Szerokość przedziału histogramu (1°) */
+#define TIMING_OFFSET_SHIFT     4  /* Poprawka w 1/16 tyknięcia - uczenie krokiem 1/16 spóźnienia na obrót */
+#define TIMING_OFFSET_MAX       16 /* Maksymalna poprawka czasu iskry [tyknięcia] */
+#define TIMING_LEARN_MAX        64 /* Większe spóźnienia (brak iskry przed GMP) nie są uczone [tyknięcia] */
+
+#ifndef TIMING_LEARN
+#define TIMING_LEARN            1  /* Uczenie poprawki włączone po starcie */
+#endif
+
+struct timing_stats {
+	uint16_t count; /* Ilość sprawdzonych iskier (po przepełnieniu ilość, suma i histogram są połowione) */
+	int16_t min; /* Błąd kąta (zrealizowane - zadane) [1/8°] */
+	int16_t max;
+	int32_t sum;
+	uint16_t histogram[TIMING_HIST_BINS]; /* Przedział i: błąd od (i - TIMING_HIST_BINS / 2)° */
+};
+
+extern int16_t __timing_offsets[MAP_RPM_SIZE]; /* Poprawka czasu iskry dla przedziałów osi obrotów [1/16 tyknięcia] */
+
+void timing_reset(void);
+void timing_set_learn(uint8_t enabled);
+void timing_read(struct timing_stats * stats, int16_t * offsets);
+void timing_record(int16_t error);
+void timing_learn(uint8_t bin, int16_t delay);
+
+/* Poprawka czasu iskry dla przedziału osi obrotów [tyknięcia] (w przerwaniu, iskra o tyle wcześniej) */
+static inline int16_t timing_offset(uint8_t bin) {
+	return __timing_offsets[bin] >> TIMING_OFFSET_SHIFT;
+}
+
+#endif /* __TIMING_H */